@@ -0,0 +1,520 @@
+// bsrender_bench: stage microbenchmarks on synthetic, NIF-free data.
+//
+// Generates a procedural body (ring-grid shapes held in memory), a matching
+// OSD file, slider set and presets, then times each pipeline stage on them:
+// OSD decoding, slider data loading, morphing, normals, rasterization at
+// several sizes, PNG/QOI encoding and GLB export. Results go to stdout as a
+// table and, with --json, as JSON. The run fails unless the morph engine
+// matches the reference path bit for bit at every supported SIMD level.
+#include "bsrender.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+struct BenchConfig {
+    std::string dataDir;
+    bool generateOnly = false;
+    size_t vertices = 30000;
+    size_t sliders = 60;
+    float sparsity = 0.1f; // fraction of a shape's vertices each slider moves
+    size_t presets = 8;
+    int iterations = 5;
+    std::vector<int> sizes = {256, 512, 1024, 2048};
+    std::string jsonPath;
+    unsigned threads = 0;
+};
+
+struct BenchData {
+    fs::path root; // BodySlide directory
+    fs::path osdPath;
+    fs::path ospPath;
+    fs::path presetsPath;
+    std::string setName = "Synthetic Body";
+    std::vector<MeshShape> shapes;
+    size_t diffEntries = 0;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string detail;
+    std::vector<double> ms;
+};
+
+static const size_t kBenchRingSegments = 64;
+static const size_t kBenchMaxShapeVerts = 60000; // OSD and NIF indices are 16-bit
+
+static void PrintBenchUsage() {
+    std::cerr << "Usage: bsrender_bench [options]\n"
+              << "  --data <dir>        Write the synthetic BodySlide data to <dir> and keep it\n"
+              << "                      (default: a temporary directory, removed afterwards)\n"
+              << "  --generate-only     Write the synthetic data and exit (requires --data)\n"
+              << "  --verts <n>         Total body vertices (default 30000)\n"
+              << "  --sliders <n>       Sliders in the slider set (default 60)\n"
+              << "  --sparsity <f>      Fraction of vertices each slider moves, 0-1 (default 0.1)\n"
+              << "  --presets <n>       Presets to generate (default 8)\n"
+              << "  --sizes <list>      Render sizes (default 256,512,1024,2048)\n"
+              << "  --iterations <n>    Timed iterations per stage (default 5)\n"
+              << "  --threads <n>       Worker threads (default: one per hardware thread)\n"
+              << "  --json <file>       Write the results as JSON (- for stdout)\n"
+              << "Exits with 4 when the morph engine and the reference path disagree.\n";
+}
+
+static bool ParseBenchArgs(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&](std::string& out) -> bool {
+            if (i + 1 >= argc) return false;
+            out = argv[++i];
+            return true;
+        };
+        // As in bsrender's ParseArgs, the whole value must parse: "1e5" is not
+        // a vertex count and "512x" is not a size.
+        auto parseNumber = [&](const std::string& val, auto& out) -> bool {
+            try {
+                size_t used = 0;
+                if constexpr (std::is_same_v<std::decay_t<decltype(out)>, float>) {
+                    out = std::stof(val, &used);
+                    if (!std::isfinite(out)) used = 0;
+                } else {
+                    out = std::stoi(val, &used);
+                    if (out < 0) used = 0;
+                }
+                if (used == val.size()) return true;
+            } catch (const std::exception&) {
+            }
+            std::cerr << "Invalid value for " << arg << ": " << val << "\n";
+            return false;
+        };
+        auto nextNumber = [&](auto& out) -> bool {
+            std::string val;
+            return next(val) && parseNumber(val, out);
+        };
+        auto nextCount = [&](auto& out) -> bool {
+            int number = 0;
+            if (!nextNumber(number)) return false;
+            out = static_cast<std::decay_t<decltype(out)>>(number);
+            return true;
+        };
+        if (arg == "--generate-only") {
+            config.generateOnly = true;
+        } else if (arg == "--data") {
+            if (!next(config.dataDir)) return false;
+        } else if (arg == "--verts") {
+            if (!nextCount(config.vertices)) return false;
+        } else if (arg == "--sliders") {
+            if (!nextCount(config.sliders)) return false;
+        } else if (arg == "--sparsity") {
+            if (!nextNumber(config.sparsity)) return false;
+        } else if (arg == "--presets") {
+            if (!nextCount(config.presets)) return false;
+        } else if (arg == "--iterations") {
+            if (!nextNumber(config.iterations)) return false;
+        } else if (arg == "--threads") {
+            if (!nextCount(config.threads)) return false;
+        } else if (arg == "--json") {
+            if (!next(config.jsonPath)) return false;
+        } else if (arg == "--sizes") {
+            std::string list;
+            if (!next(list)) return false;
+            config.sizes.clear();
+            std::stringstream ss(list);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                int size = 0;
+                if (!parseNumber(item, size)) return false;
+                if (size < 16 || size > 8192) return false;
+                config.sizes.push_back(size);
+            }
+        } else {
+            return false;
+        }
+    }
+    if (config.vertices < 4 * kBenchRingSegments || config.sliders == 0 || config.presets == 0) return false;
+    if (!(config.sparsity > 0.0f && config.sparsity <= 1.0f)) return false;
+    if (config.iterations < 1 || config.sizes.empty()) return false;
+    if (config.generateOnly && config.dataDir.empty()) return false;
+    return true;
+}
+
+// A closed tube of `rings` x kBenchRingSegments vertices, bulging in the
+// middle like a torso.
+static MeshShape MakeRingShape(const std::string& name, size_t rings, float cx, float radius, float height) {
+    const size_t segs = kBenchRingSegments;
+    MeshShape shape;
+    shape.name = name;
+    shape.targetName = name;
+    shape.verts.reserve(rings * segs);
+    for (size_t i = 0; i < rings; ++i) {
+        const float t = static_cast<float>(i) / static_cast<float>(rings - 1);
+        const float r = radius * (0.6f + 0.4f * std::sin(3.14159265f * t));
+        for (size_t j = 0; j < segs; ++j) {
+            const float a = 6.28318531f * static_cast<float>(j) / static_cast<float>(segs);
+            shape.verts.emplace_back(cx + r * std::cos(a), r * 0.7f * std::sin(a), height * t);
+        }
+    }
+    for (size_t i = 0; i + 1 < rings; ++i) {
+        for (size_t j = 0; j < segs; ++j) {
+            const auto a = static_cast<uint16_t>(i * segs + j);
+            const auto b = static_cast<uint16_t>(i * segs + (j + 1) % segs);
+            const auto c = static_cast<uint16_t>((i + 1) * segs + j);
+            const auto d = static_cast<uint16_t>((i + 1) * segs + (j + 1) % segs);
+            nifly::Triangle t0;
+            t0.p1 = a;
+            t0.p2 = c;
+            t0.p3 = b;
+            nifly::Triangle t1;
+            t1.p1 = b;
+            t1.p2 = c;
+            t1.p3 = d;
+            shape.tris.push_back(t0);
+            shape.tris.push_back(t1);
+        }
+    }
+    return shape;
+}
+
+template <typename T>
+static void WriteRaw(std::ofstream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Writes the body as BodySlide data under <dir>/BodySlide: one OSD with a
+// block per slider and shape, a slider set referencing it, and presets that
+// set a random half of the sliders. Each slider moves one contiguous band of
+// `sparsity` x shape vertices, as real sliders touch one body region.
+static bool GenerateBenchData(const BenchConfig& config, const fs::path& dir, BenchData& data) {
+    data.root = dir / "BodySlide";
+    const fs::path shapeDir = data.root / "ShapeData" / "Synthetic";
+    std::error_code ec;
+    fs::create_directories(shapeDir, ec);
+    fs::create_directories(data.root / "SliderSets", ec);
+    fs::create_directories(data.root / "SliderPresets", ec);
+    if (ec) {
+        std::cerr << "Failed to create " << data.root.string() << ": " << ec.message() << "\n";
+        return false;
+    }
+
+    const size_t shapeCount = (config.vertices + kBenchMaxShapeVerts - 1) / kBenchMaxShapeVerts;
+    const size_t ringsPerShape = std::max<size_t>(4, config.vertices / shapeCount / kBenchRingSegments);
+    data.shapes.clear();
+    for (size_t s = 0; s < shapeCount; ++s) {
+        data.shapes.push_back(MakeRingShape(s == 0 ? std::string("Body") : "Body" + std::to_string(s), ringsPerShape,
+                                            40.0f * static_cast<float>(s), 15.0f, 120.0f));
+    }
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> delta(-1.0f, 1.0f);
+
+    data.osdPath = shapeDir / "body.osd";
+    std::ofstream osd(data.osdPath, std::ios::binary);
+    osd.write("OSD\0", 4);
+    WriteRaw<uint32_t>(osd, 1);
+    WriteRaw<uint32_t>(osd, static_cast<uint32_t>(config.sliders * shapeCount));
+    data.diffEntries = 0;
+    for (size_t k = 0; k < config.sliders; ++k) {
+        const std::string sliderName = "Slider" + std::to_string(k);
+        for (const auto& shape : data.shapes) {
+            const size_t n = shape.verts.size();
+            const size_t count = std::min<size_t>(
+                {n, 65535, std::max<size_t>(1, static_cast<size_t>(config.sparsity * static_cast<float>(n)))});
+            const size_t start = std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+            const std::string blockName = shape.name + sliderName;
+            WriteRaw<uint8_t>(osd, static_cast<uint8_t>(blockName.size()));
+            osd.write(blockName.data(), static_cast<std::streamsize>(blockName.size()));
+            WriteRaw<uint16_t>(osd, static_cast<uint16_t>(count));
+            for (size_t i = 0; i < count; ++i) {
+                WriteRaw<uint16_t>(osd, static_cast<uint16_t>((start + i) % n));
+                WriteRaw<float>(osd, delta(rng));
+                WriteRaw<float>(osd, delta(rng));
+                WriteRaw<float>(osd, delta(rng));
+            }
+            data.diffEntries += count;
+        }
+    }
+    osd.close();
+    if (!osd) {
+        std::cerr << "Failed to write " << data.osdPath.string() << "\n";
+        return false;
+    }
+
+    data.ospPath = data.root / "SliderSets" / "synthetic.osp";
+    std::ofstream osp(data.ospPath);
+    osp << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<SliderSetInfo version=\"1\">\n"
+        << "  <SliderSet name=\"" << data.setName << "\">\n"
+        << "    <DataFolder>Synthetic</DataFolder>\n    <SourceFile>body.nif</SourceFile>\n"
+        << "    <OutputPath>meshes</OutputPath>\n    <OutputFile>body</OutputFile>\n";
+    for (const auto& shape : data.shapes) {
+        osp << "    <Shape target=\"" << shape.name << "\" DataFolder=\"Synthetic\">" << shape.name << "</Shape>\n";
+    }
+    for (size_t k = 0; k < config.sliders; ++k) {
+        const std::string sliderName = "Slider" + std::to_string(k);
+        osp << "    <Slider name=\"" << sliderName << "\" invert=\"" << (k % 7 == 3 ? "true" : "false")
+            << "\" default=\"" << (k % 6 == 1 ? 30 : 0) << "\">\n";
+        for (const auto& shape : data.shapes) {
+            osp << "      <Data name=\"" << shape.name << sliderName << "\" target=\"" << shape.name
+                << "\" local=\"true\">body.osd\\" << shape.name << sliderName << "</Data>\n";
+        }
+        osp << "    </Slider>\n";
+    }
+    osp << "  </SliderSet>\n</SliderSetInfo>\n";
+    osp.close();
+
+    data.presetsPath = data.root / "SliderPresets" / "synthetic.xml";
+    std::ofstream presets(data.presetsPath);
+    static const char* const kSizes[] = {"big", "small", "both"};
+    presets << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<SliderPresets>\n";
+    for (size_t p = 0; p < config.presets; ++p) {
+        presets << "    <Preset name=\"Synthetic " << p << "\" set=\"" << data.setName << "\">\n";
+        for (size_t k = 0; k < config.sliders; ++k) {
+            if (rng() % 2) continue;
+            presets << "        <SetSlider name=\"Slider" << k << "\" size=\"" << kSizes[rng() % 3]
+                    << "\" value=\"" << static_cast<int>(rng() % 201) - 50 << "\"/>\n";
+        }
+        presets << "    </Preset>\n";
+    }
+    presets << "</SliderPresets>\n";
+    presets.close();
+
+    if (!osp || !presets) {
+        std::cerr << "Failed to write the synthetic slider set or presets\n";
+        return false;
+    }
+    return true;
+}
+
+// Runs `setup` then times `fn`, once untimed as warm-up and then `iterations`
+// times.
+template <typename Setup, typename Fn>
+static BenchResult Measure(const std::string& name, const std::string& detail, int iterations, Setup&& setup,
+                           Fn&& fn) {
+    BenchResult result;
+    result.name = name;
+    result.detail = detail;
+    for (int i = 0; i <= iterations; ++i) {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (i > 0) result.ms.push_back(ms);
+    }
+    return result;
+}
+
+template <typename Fn>
+static BenchResult Measure(const std::string& name, const std::string& detail, int iterations, Fn&& fn) {
+    return Measure(name, detail, iterations, [] {}, std::forward<Fn>(fn));
+}
+
+struct BenchStats {
+    double min = 0.0;
+    double median = 0.0;
+    double mean = 0.0;
+    double max = 0.0;
+};
+
+static BenchStats ComputeStats(std::vector<double> ms) {
+    BenchStats stats;
+    if (ms.empty()) return stats;
+    std::sort(ms.begin(), ms.end());
+    stats.min = ms.front();
+    stats.max = ms.back();
+    const size_t mid = ms.size() / 2;
+    stats.median = ms.size() % 2 ? ms[mid] : 0.5 * (ms[mid - 1] + ms[mid]);
+    double total = 0.0;
+    for (double v : ms) total += v;
+    stats.mean = total / static_cast<double>(ms.size());
+    return stats;
+}
+
+static void WriteBenchJson(std::ostream& out, const BenchConfig& config, const BenchData& data, size_t vertices,
+                           size_t triangles, const std::vector<BenchResult>& results) {
+    out << std::fixed << std::setprecision(4);
+    out << "{\n  \"threads\": " << WorkerPool().Size() << ",\n  \"simd\": " << JsonQuote(SimdLevelName(gSimdLevel))
+        << ",\n  \"config\": {\"vertices\": " << config.vertices << ", \"sliders\": " << config.sliders
+        << ", \"sparsity\": " << config.sparsity << ", \"presets\": " << config.presets
+        << ", \"iterations\": " << config.iterations << "},\n  \"data\": {\"shapes\": " << data.shapes.size()
+        << ", \"vertices\": " << vertices << ", \"triangles\": " << triangles
+        << ", \"diffEntries\": " << data.diffEntries << "},\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchStats stats = ComputeStats(results[i].ms);
+        out << (i ? ",\n" : "\n") << "    {\"name\": " << JsonQuote(results[i].name)
+            << ", \"detail\": " << JsonQuote(results[i].detail) << ", \"iterations\": " << results[i].ms.size()
+            << ", \"minMs\": " << stats.min << ", \"medianMs\": " << stats.median << ", \"meanMs\": " << stats.mean
+            << ", \"maxMs\": " << stats.max << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static int RunBenchSuite(const BenchConfig& config, const BenchData& data) {
+    const int iterations = config.iterations;
+    std::vector<BenchResult> results;
+
+    SliderSet sliderSet;
+    if (!LoadSliderSetFromFile(data.ospPath, data.setName, sliderSet)) {
+        std::cerr << "Failed to read the synthetic slider set\n";
+        return 2;
+    }
+    Preset preset;
+    if (!LoadPresetFromFile(data.presetsPath, "Synthetic 0", preset)) {
+        std::cerr << "Failed to read the synthetic presets\n";
+        return 2;
+    }
+    const fs::path shapeDataRoot = data.root / "ShapeData";
+
+    results.push_back(Measure("osd_read", "all blocks", iterations, [&] {
+        OSDFile osd;
+        osd.Read(data.osdPath);
+    }));
+
+    DiffDataSets diffData;
+    results.push_back(Measure("diff_load", "resolve + load", iterations, [&] {
+        diffData = DiffDataSets();
+        diffData.LoadData(ResolveOsdRefs(sliderSet, shapeDataRoot, false));
+    }));
+
+    // As LoadBody does once per body; the engine stages below include resolving
+    // the preset's slider values, which a render job does once.
+    std::vector<MeshShape> baseShapes = data.shapes;
+    InternMorphSymbols(sliderSet, baseShapes, diffData);
+    results.push_back(Measure("preset_resolve", preset.name, iterations, [&] {
+        ResolvePresetValues(preset, sliderSet);
+    }));
+    results.push_back(Measure("morph_plan", preset.name, iterations, [&] {
+        BuildMorphPlans(ResolvePresetValues(preset, sliderSet), sliderSet, diffData, baseShapes, false);
+    }));
+
+    std::vector<MeshShape> shapes;
+    auto resetShapes = [&] { shapes = baseShapes; };
+    results.push_back(Measure("morph_reference", preset.name, iterations, resetShapes, [&] {
+        MorphShapesReference(preset, sliderSet, diffData, shapes);
+    }));
+    results.push_back(Measure("morph_engine", SimdLevelName(gSimdLevel), iterations, resetShapes, [&] {
+        MorphShapes(ResolvePresetValues(preset, sliderSet), sliderSet, diffData, false, shapes);
+    }));
+
+    // Timings of a wrong engine are worthless; every kernel must reproduce the
+    // reference bit for bit, as `bsrender bench` requires.
+    std::vector<MeshShape> expected = baseShapes;
+    MorphShapesReference(preset, sliderSet, diffData, expected);
+    std::vector<SimdLevel> levels = {SimdLevel::Scalar};
+    if (gSimdLevel != SimdLevel::Scalar) levels.push_back(SimdLevel::Sse2);
+    if (gSimdLevel == SimdLevel::Avx2) levels.push_back(SimdLevel::Avx2);
+    for (SimdLevel level : levels) {
+        std::vector<MeshShape> morphed = baseShapes;
+        MorphShapes(ResolvePresetValues(preset, sliderSet), sliderSet, diffData, false, morphed, level);
+        if (!SameVertices(morphed, expected)) {
+            std::cerr << "Morph engine (" << SimdLevelName(level) << ") differs from the reference path\n";
+            return 4;
+        }
+    }
+
+    std::vector<Vec3> verts;
+    std::vector<std::array<uint32_t, 3>> tris;
+    ConcatenateShapes(shapes, verts, tris);
+
+    VertexAdjacency adjacency;
+    results.push_back(Measure("adjacency", "once per body", iterations, [&] {
+        adjacency = BuildVertexAdjacency(verts.size(), tris);
+    }));
+    std::vector<Vec3> normals;
+    results.push_back(Measure("normals", "cached adjacency", iterations, [&] {
+        normals = ComputeVertexNormals(verts, tris, &adjacency);
+    }));
+
+    const std::vector<ViewAngles> views(1);
+    std::vector<std::vector<uint8_t>> images;
+    int encodeSize = 0;
+    for (int size : config.sizes) {
+        results.push_back(Measure("render_" + std::to_string(size), "1 view", iterations, [&] {
+            RenderViews(verts, normals, tris, size, views, images);
+        }));
+        encodeSize = size;
+    }
+
+    // Encoders run on the last rendered image.
+    const uint8_t* rgba = images.front().data();
+    const std::string sizeLabel = std::to_string(encodeSize) + "x" + std::to_string(encodeSize);
+    for (int level : {1, 6, 9}) {
+        results.push_back(Measure("png_level" + std::to_string(level), sizeLabel, iterations, [&] {
+            EncodePng(rgba, encodeSize, encodeSize, level);
+        }));
+    }
+    results.push_back(Measure("qoi", sizeLabel, iterations, [&] { EncodeQoi(rgba, encodeSize, encodeSize); }));
+
+    const std::string glbPath = (data.root / "bench.glb").string();
+    results.push_back(Measure("glb", "float", iterations, [&] {
+        ExportGlb(glbPath, verts, tris, normals, false);
+    }));
+    results.push_back(Measure("glb_compact", "quantized", iterations, [&] {
+        ExportGlb(glbPath, verts, tris, normals, true);
+    }));
+    std::error_code ec;
+    fs::remove(glbPath, ec);
+
+    const bool jsonToStdout = config.jsonPath == "-";
+    std::ostream& table = jsonToStdout ? std::cerr : std::cout;
+    table << "Bench: " << data.shapes.size() << " shapes, " << verts.size() << " vertices, " << tris.size()
+          << " triangles, " << config.sliders << " sliders, " << data.diffEntries << " diff entries, "
+          << iterations << " iterations, " << WorkerPool().Size() << " thread(s)\n";
+    table << std::fixed << std::setprecision(3);
+    for (const auto& result : results) {
+        const BenchStats stats = ComputeStats(result.ms);
+        table << "  " << std::left << std::setw(16) << result.name << std::setw(16) << result.detail << std::right
+              << " min " << std::setw(10) << stats.min << "  median " << std::setw(10) << stats.median << "  mean "
+              << std::setw(10) << stats.mean << " ms\n";
+    }
+
+    if (jsonToStdout) {
+        WriteBenchJson(std::cout, config, data, verts.size(), tris.size(), results);
+    } else if (!config.jsonPath.empty()) {
+        std::ofstream json(config.jsonPath);
+        WriteBenchJson(json, config, data, verts.size(), tris.size(), results);
+        if (!json) {
+            std::cerr << "Failed to write " << config.jsonPath << "\n";
+            return 3;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!ParseBenchArgs(argc, argv, config)) {
+        PrintBenchUsage();
+        return 1;
+    }
+    gThreadCount = config.threads;
+
+    fs::path dir = config.dataDir;
+    const bool temporary = dir.empty();
+    if (temporary) {
+        std::error_code ec;
+        dir = fs::temp_directory_path(ec) /
+              ("bsrender-bench-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+        if (ec) {
+            std::cerr << "No temporary directory: " << ec.message() << "\n";
+            return 3;
+        }
+    }
+
+    BenchData data;
+    if (!GenerateBenchData(config, dir, data)) return 3;
+    int rc = 0;
+    if (config.generateOnly) {
+        std::cout << "Generated: " << data.root.string() << " (" << data.diffEntries << " diff entries)\n";
+    } else {
+        rc = RunBenchSuite(config, data);
+    }
+
+    if (temporary) {
+        std::error_code ec;
+        fs::remove_all(dir, ec);
+    }
+    return rc;
+}
@@ -0,0 +1,6494 @@
+#include "bsrender.h"
+
+#include <tinyxml2.h>
+
+#include <NifFile.hpp>
+#include <Geometry.hpp>
+#include <BasicTypes.hpp>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BSRENDER_X86_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BSRENDER_TARGET_AVX2
+#else
+#define BSRENDER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using tinyxml2::XMLElement;
+using tinyxml2::XMLDocument;
+
+static bool gVerbose = false;
+unsigned gThreadCount = 0;
+
+// Pipeline stages timed by --profile / --stats-json.
+enum class ProfileStage {
+    PresetLookup,
+    SliderSetLookup,
+    PackLoad,
+    NifLoad,
+    OsdResolve,
+    OsdRead,
+    PackWrite,
+    RenderCache,
+    Morph,
+    Normals,
+    Raster,
+    Encode,
+    GlbWrite,
+    Count
+};
+
+static const char* const kProfileStageNames[] = {
+    "preset_lookup", "slider_set_lookup", "pack_load", "nif_load", "osd_resolve", "osd_read", "pack_write",
+    "render_cache",  "morph",             "normals",   "raster",   "encode",      "glb_write",
+};
+static_assert(sizeof(kProfileStageNames) / sizeof(kProfileStageNames[0]) == static_cast<size_t>(ProfileStage::Count),
+              "one name per profile stage");
+
+struct ProfileStageStats {
+    uint64_t calls = 0;
+    double wallMs = 0.0;
+    double cpuMs = 0.0;
+    std::atomic<uint64_t> bytesRead{0};
+};
+
+struct ProfileCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+// Process-wide profile. Stages are entered on the main thread only; bytes read
+// may be reported from workers and go to the stage open at the time.
+struct Profile {
+    bool enabled = false;
+    std::chrono::steady_clock::time_point start;
+    ProfileStageStats stages[static_cast<size_t>(ProfileStage::Count)];
+    std::atomic<int> currentStage{-1};
+    std::atomic<uint64_t> bytesRead{0};
+
+    uint64_t jobs = 0;
+    uint64_t views = 0;
+    uint64_t vertices = 0;
+    uint64_t triangles = 0;
+    uint64_t activeSliders = 0;
+    uint64_t diffEntries = 0; // morph entries applied
+    uint64_t fragments = 0;   // pixels shaded
+
+    ProfileCacheStats bodies;
+    ProfileCacheStats morphPacks;
+    ProfileCacheStats contentHashes;
+};
+
+static Profile gProfile;
+
+// CPU time of the whole process, all threads, in milliseconds.
+static double ProcessCpuMs() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0.0;
+    auto ticks = [](const FILETIME& t) { return (static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime; };
+    return static_cast<double>(ticks(kernel) + ticks(user)) / 10000.0;
+#else
+    timespec ts{};
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return 0.0;
+    return static_cast<double>(ts.tv_sec) * 1000.0 + static_cast<double>(ts.tv_nsec) / 1e6;
+#endif
+}
+
+static uint64_t PeakRssBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return static_cast<uint64_t>(counters.PeakWorkingSetSize);
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static void ProfileBytesRead(uint64_t bytes) {
+    if (!gProfile.enabled) return;
+    gProfile.bytesRead += bytes;
+    const int stage = gProfile.currentStage.load();
+    if (stage >= 0) gProfile.stages[stage].bytesRead += bytes;
+}
+
+// Times one stage while in scope. Scopes nest; a stage's time excludes the
+// stages opened inside it, so the stage times add up to the profiled total.
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileStage stage) {
+        if (!gProfile.enabled) return;
+        active_ = true;
+        stage_ = static_cast<int>(stage);
+        parent_ = current_;
+        current_ = this;
+        gProfile.currentStage = stage_;
+        start_ = std::chrono::steady_clock::now();
+        startCpu_ = ProcessCpuMs();
+    }
+
+    ~ProfileScope() {
+        if (!active_) return;
+        const double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+        const double cpu = ProcessCpuMs() - startCpu_;
+        ProfileStageStats& stats = gProfile.stages[stage_];
+        stats.calls++;
+        stats.wallMs += wall - childWallMs_;
+        stats.cpuMs += cpu - childCpuMs_;
+        if (parent_) {
+            parent_->childWallMs_ += wall;
+            parent_->childCpuMs_ += cpu;
+        }
+        current_ = parent_;
+        gProfile.currentStage = parent_ ? parent_->stage_ : -1;
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    static inline ProfileScope* current_ = nullptr;
+    bool active_ = false;
+    int stage_ = 0;
+    ProfileScope* parent_ = nullptr;
+    std::chrono::steady_clock::time_point start_;
+    double startCpu_ = 0.0;
+    double childWallMs_ = 0.0;
+    double childCpuMs_ = 0.0;
+};
+
+struct RenderJob {
+    std::string presetName;
+    std::string presetFile;
+    std::string outPath;
+    std::string exportGlbPath;
+};
+
+enum class ImageFormat {
+    Png,
+    Qoi
+};
+
+static bool ParseImageFormat(const std::string& name, ImageFormat& out) {
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (lower == "png") {
+        out = ImageFormat::Png;
+    } else if (lower == "qoi") {
+        out = ImageFormat::Qoi;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+struct Args {
+    std::string command;
+    std::string dataRoot;
+    std::string sliderSetName;
+    std::string batchFile;
+    std::string outDir;
+    std::string catalogPath; // 'catalog' --out; empty writes to stdout
+    std::string rulesPath;   // 'bodygen' --rules
+    std::string formIdsDir;  // 'bodygen' --formids: folder with NPCs/ and Races/ CSVs
+    std::string gameDataDir; // 'bodygen' --game-data; default: two levels above --data-root
+    std::vector<RenderJob> jobs;
+    bool serve = false;
+    std::string cacheDir;
+    bool noCache = false;
+    bool memoryReport = false;
+    bool renderCache = false;
+    bool profile = false;
+    std::string statsJsonPath; // --stats-json; implies profiling
+    int iterations = 200;
+    unsigned threads = 0;
+    int size = 1024;
+    bool verbose = false;
+    float yawDeg = 45.0f;
+    float pitchDeg = 0.0f;
+    float rollDeg = 0.0f;
+    std::string viewSpec; // --views; empty renders the single --yaw/--pitch/--roll view
+    bool sheet = false;
+    int sheetColumns = 0; // 0: square-ish grid
+    std::string imageFormat; // --format; empty picks by output extension
+    int pngLevel = 6;
+    int mipLevels = 0; // --mips: half-size levels written next to each image
+    bool exportYUp = true;
+    bool exportCompact = false;
+};
+
+// Expands a --views spec into view angles. "turntable:N" steps the yaw through
+// a full turn starting at the base view; otherwise the spec is a comma list of
+// "yaw" or "yaw:pitch:roll" items, with omitted angles taken from the base view.
+static bool ParseViewSpec(const std::string& spec, const ViewAngles& base, std::vector<ViewAngles>& out) {
+    out.clear();
+    if (spec.empty()) {
+        out.push_back(base);
+        return true;
+    }
+
+    try {
+        const std::string turntable = "turntable:";
+        if (spec.compare(0, turntable.size(), turntable) == 0) {
+            const std::string count = spec.substr(turntable.size());
+            size_t used = 0;
+            int steps = std::stoi(count, &used);
+            if (used != count.size() || steps < 1 || steps > 360) return false;
+            for (int i = 0; i < steps; ++i) {
+                ViewAngles view = base;
+                view.yawDeg = base.yawDeg + 360.0f * static_cast<float>(i) / static_cast<float>(steps);
+                out.push_back(view);
+            }
+            return true;
+        }
+
+        size_t start = 0;
+        while (start <= spec.size()) {
+            size_t comma = spec.find(',', start);
+            std::string item = spec.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+            if (item.empty()) return false;
+
+            ViewAngles view = base;
+            float* angles[3] = {&view.yawDeg, &view.pitchDeg, &view.rollDeg};
+            size_t pos = 0;
+            for (int a = 0; a < 3 && pos <= item.size(); ++a) {
+                size_t colon = item.find(':', pos);
+                std::string part = item.substr(pos, colon == std::string::npos ? std::string::npos : colon - pos);
+                if (!part.empty()) {
+                    size_t used = 0;
+                    *angles[a] = std::stof(part, &used);
+                    if (used != part.size() || !std::isfinite(*angles[a])) return false;
+                }
+                if (colon == std::string::npos) {
+                    pos = std::string::npos;
+                    break;
+                }
+                pos = colon + 1;
+            }
+            if (pos != std::string::npos) return false;
+            out.push_back(view);
+
+            if (comma == std::string::npos) break;
+            start = comma + 1;
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    return !out.empty() && out.size() <= 360;
+}
+
+// Sprite sheet layout: --sheet-columns views per row, else a square-ish grid.
+static void SheetGrid(const Args& args, size_t viewCount, size_t& outColumns, size_t& outRows) {
+    outColumns = args.sheetColumns > 0
+        ? std::min(viewCount, static_cast<size_t>(args.sheetColumns))
+        : static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(viewCount))));
+    outRows = (viewCount + outColumns - 1) / outColumns;
+}
+
+// Largest sprite sheet written, in pixels (1 GiB of RGBA).
+constexpr uint64_t kMaxSheetPixels = uint64_t(1) << 28;
+
+static bool SheetFits(const Args& args, size_t viewCount) {
+    size_t columns = 0;
+    size_t rows = 0;
+    SheetGrid(args, viewCount, columns, rows);
+    const uint64_t side = static_cast<uint64_t>(args.size);
+    return columns * side * rows * side <= kMaxSheetPixels;
+}
+
+static void PrintUsage() {
+    std::cout
+        << "bsrender --preset-name <name> --data-root <BodySlideData> --out <file.png> [options]\n"
+        << "bsrender --batch <manifest.txt> --data-root <BodySlideData> [options]\n"
+        << "bsrender --serve --data-root <BodySlideData> [options]\n"
+        << "bsrender compile --data-root <BodySlideData> [--slider-set <name>] [options]\n"
+        << "bsrender bench --preset-name <name> --data-root <BodySlideData> [--iterations <n>]\n"
+        << "bsrender morphs --data-root <BodySlideData> --out-dir <dir> [--slider-set <name>] [options]\n"
+        << "bsrender catalog --data-root <BodySlideData> [--out <file.json>] [options]\n"
+        << "bsrender bodygen --data-root <BodySlideData> --rules <file> --out-dir <BodyGen dir>\n"
+        << "                 [--formids <FormIDs dir>] [--game-data <Data dir>] [options]\n"
+        << "\nOptions:\n"
+        << "  --preset-file <file>    Preset XML file to search (optional)\n"
+        << "  --slider-set <name>     Override slider set name (optional)\n"
+        << "  --size <px>             Output image size (default 1024)\n"
+        << "  --export-glb <file>     Export deformed mesh to GLB\n"
+        << "  --export-no-yup         Do not convert to Y-up for GLB export\n"
+        << "  --export-compact        Quantize GLB positions/normals (KHR_mesh_quantization)\n"
+        << "                          and use 16-bit indices when they fit\n"
+        << "  --yaw <deg>             Yaw around Z axis (default 45)\n"
+        << "  --pitch <deg>           Pitch around X axis (default 0)\n"
+        << "  --roll <deg>            Roll around Y axis (default 0)\n"
+        << "  --views <spec>          Render several views of one morph: 'turntable:<n>' or a\n"
+        << "                          comma list of yaw[:pitch[:roll]] angles. Each view is\n"
+        << "                          written to <out>_<i>.png unless --sheet is given\n"
+        << "  --sheet                 Write all views into one sprite sheet at --out\n"
+        << "                          (at most 2^28 pixels in total)\n"
+        << "  --sheet-columns <n>     Views per sheet row (default: square grid)\n"
+        << "  --format <png|qoi>      Output image encoder (default: by --out extension, else png)\n"
+        << "  --png-level <0-9>       PNG compression level (default 6). 0 stores uncompressed;\n"
+        << "                          1-3 use one filter and a light match search (about 5x\n"
+        << "                          faster than 6, files about 30% larger); 4-9 try every\n"
+        << "                          filter per row and search harder as the level rises\n"
+        << "  --mips <n>              Also write n box-filtered half-size levels of each image\n"
+        << "                          as <out>_<width>.png (e.g. --size 1024 --mips 3 adds\n"
+        << "                          512, 256 and 128 px images)\n"
+        << "  --batch <file>          Render every preset listed in a manifest file\n"
+        << "  --cache-dir <dir>       Directory for lookup caches (default: <temp>/bsrender-cache)\n"
+        << "                          Preset, slider set and ShapeData indexes are used with\n"
+        << "                          --cache-dir, --serve, several jobs or a subcommand\n"
+        << "  --no-cache              Do not read or write cache files\n"
+        << "  --render-cache          Reuse earlier renders with identical inputs; needs\n"
+        << "                          --cache-dir (see below)\n"
+        << "  --memory-report         Print memory used by the loaded OSD diff data\n"
+        << "  --profile               Print wall/CPU time and bytes read per stage, counts,\n"
+        << "                          peak memory and cache hit rates when done\n"
+        << "  --stats-json <file>     Write the same profile as one JSON document\n"
+        << "  --iterations <n>        Morphs per measured path in 'bench' (default 200)\n"
+        << "  --threads <n>           Worker threads (default: one per hardware thread)\n"
+        << "  --verbose               Extra logging\n"
+        << "\nBatch mode:\n"
+        << "  --preset-name may be repeated; --preset-file, --out and --export-glb apply to\n"
+        << "  the preset named before them. Manifest lines are tab-separated:\n"
+        << "    <preset name>\t<out.png>[\t<out.glb>[\t<preset file>]]\n"
+        << "  Presets sharing a slider set reuse its loaded mesh and OSD data.\n"
+        << "\nServer mode:\n"
+        << "  --serve reads one JSON request per line from stdin and writes one JSON\n"
+        << "  response per line to stdout; logging goes to stderr. Requests:\n"
+        << "    {\"id\":1,\"op\":\"render\",\"preset\":\"name\",\"out\":\"a.png\",\"glb\":\"a.glb\",\n"
+        << "     \"presetFile\":\"f.xml\",\"sliderSet\":\"s\",\"size\":1024,\"yaw\":45,\"pitch\":0,\"roll\":0,\n"
+        << "     \"views\":\"turntable:8\",\"sheet\":true,\"format\":\"qoi\",\"mips\":3,\"compact\":true}\n"
+        << "    {\"op\":\"ping\"}  {\"op\":\"invalidate\"}  {\"op\":\"stats\"}  {\"op\":\"shutdown\"}\n"
+        << "  Loaded slider sets stay resident; changed .osp/NIF files reload their set and\n"
+        << "  changed OSD files reload only their diff data. With --profile or --stats-json,\n"
+        << "  'stats' returns the profile so far under \"stats\"; the file is written on exit.\n"
+        << "\nMorph packs:\n"
+        << "  With --cache-dir, loaded slider sets are stored as memory-mapped morph packs\n"
+        << "  under it and used instead of the .osp/NIF/OSD files until one of those\n"
+        << "  changes or an OSD file would resolve differently. 'compile' builds the pack\n"
+        << "  for --slider-set, or for every slider set referenced by a preset, ahead of\n"
+        << "  time.\n"
+        << "\nRender cache:\n"
+        << "  --render-cache keys each render by the preset's effective slider weights, the\n"
+        << "  content of the slider set's .osp/NIF/OSD files, the views, size and output\n"
+        << "  options, and keeps the outputs under <cache-dir>/renders/<key>. A job whose\n"
+        << "  key is already stored copies the files instead of rendering, so renamed or\n"
+        << "  duplicated presets and edits that change no slider value cost no render.\n"
+        << "  Needs an explicit --cache-dir; stored renders are kept until removed by hand.\n"
+        << "\nMorph export:\n"
+        << "  'morphs' writes <set>.glb per slider set (--slider-set, or every set referenced\n"
+        << "  by a preset) holding the base mesh and one sparse morph target per slider,\n"
+        << "  named in mesh.extras.targetNames, and <set>.json with the target weights of\n"
+        << "  every preset of that set. uv sliders are listed under \"skipped\"; presets\n"
+        << "  with a positive clamp slider, which weights cannot reproduce exactly, are\n"
+        << "  listed under \"inexact\". --export-compact and --export-no-yup apply.\n"
+        << "\nPreset catalog:\n"
+        << "  'catalog' writes every preset under SliderPresets as one JSON document:\n"
+        << "    {\"version\":1,\"presets\":[{\"name\":..,\"set\":..,\"file\":..,\"big\":{..},\"small\":{..}}]}\n"
+        << "  with slider values as written in the XML (0-100). Files are scanned in\n"
+        << "  parallel with a streaming parser; unchanged files come from the preset\n"
+        << "  index in the cache directory, which batch and server runs also use.\n"
+        << "\nBodyGen:\n"
+        << "  'bodygen' reads rules in the app's template format: '#morphs=<rule>;...'\n"
+        << "  lines, each followed by '<name>=<slider>@<value>,...' templates or bare\n"
+        << "  preset names, whose templates come from the preset index (XML value / 100).\n"
+        << "  With --formids, NPC rules naming an editor ID or name ('Fallout4.esm|Piper')\n"
+        << "  get the NPC's FormID and 'All|<gender>|<race>' rules naming a race get its\n"
+        << "  editor ID; the CSVs are indexed once into the cache directory. templates.ini\n"
+        << "  and morphs.ini are written to <out-dir>/<esm>/ for every .esm in --game-data\n"
+        << "  (default: the Data folder holding Tools/BodySlide); unchanged files are not\n"
+        << "  rewritten.\n";
+}
+
+static bool ParseArgs(int argc, char** argv, Args& args) {
+    auto job = [&]() -> RenderJob& {
+        if (args.jobs.empty()) args.jobs.emplace_back();
+        return args.jobs.back();
+    };
+
+    int first = 1;
+    if (argc > 1 && (std::string(argv[1]) == "compile" || std::string(argv[1]) == "bench" ||
+                     std::string(argv[1]) == "morphs" || std::string(argv[1]) == "catalog" ||
+                     std::string(argv[1]) == "bodygen")) {
+        args.command = argv[1];
+        first = 2;
+    }
+
+    for (int i = first; i < argc; ++i) {
+        std::string key = argv[i];
+        auto next = [&](std::string& out) -> bool {
+            if (i + 1 >= argc) return false;
+            out = argv[++i];
+            return true;
+        };
+        // Numbers must be consumed whole; "12px" or "abc" is reported, not thrown.
+        auto nextNumber = [&](auto& out) -> bool {
+            std::string val;
+            if (!next(val)) return false;
+            try {
+                size_t used = 0;
+                if constexpr (std::is_same_v<std::decay_t<decltype(out)>, float>) {
+                    out = std::stof(val, &used);
+                    if (!std::isfinite(out)) used = 0;
+                } else {
+                    out = std::stoi(val, &used);
+                }
+                if (used == val.size()) return true;
+            } catch (const std::exception&) {
+            }
+            std::cerr << "Invalid value for " << key << ": " << val << "\n";
+            return false;
+        };
+        int number = 0;
+        if (key == "--data-root") {
+            if (!next(args.dataRoot)) return false;
+        } else if (key == "--preset-name") {
+            if (!args.jobs.empty() && !args.jobs.back().presetName.empty()) {
+                args.jobs.emplace_back();
+            }
+            if (!next(job().presetName)) return false;
+        } else if (key == "--preset-file") {
+            if (!next(job().presetFile)) return false;
+        } else if (key == "--slider-set") {
+            if (!next(args.sliderSetName)) return false;
+        } else if (key == "--out") {
+            if (!next(args.command == "catalog" ? args.catalogPath : job().outPath)) return false;
+        } else if (key == "--out-dir") {
+            if (!next(args.outDir)) return false;
+        } else if (key == "--rules") {
+            if (!next(args.rulesPath)) return false;
+        } else if (key == "--formids") {
+            if (!next(args.formIdsDir)) return false;
+        } else if (key == "--game-data") {
+            if (!next(args.gameDataDir)) return false;
+        } else if (key == "--size") {
+            if (!nextNumber(number)) return false;
+            args.size = std::max(64, number);
+        } else if (key == "--export-glb") {
+            if (!next(job().exportGlbPath)) return false;
+        } else if (key == "--export-no-yup") {
+            args.exportYUp = false;
+        } else if (key == "--export-compact") {
+            args.exportCompact = true;
+        } else if (key == "--yaw") {
+            if (!nextNumber(args.yawDeg)) return false;
+        } else if (key == "--pitch") {
+            if (!nextNumber(args.pitchDeg)) return false;
+        } else if (key == "--roll") {
+            if (!nextNumber(args.rollDeg)) return false;
+        } else if (key == "--views") {
+            if (!next(args.viewSpec)) return false;
+        } else if (key == "--sheet") {
+            args.sheet = true;
+        } else if (key == "--sheet-columns") {
+            if (!nextNumber(number)) return false;
+            args.sheetColumns = std::max(0, number);
+        } else if (key == "--format") {
+            ImageFormat format;
+            if (!next(args.imageFormat) || !ParseImageFormat(args.imageFormat, format)) return false;
+        } else if (key == "--png-level") {
+            if (!nextNumber(number)) return false;
+            args.pngLevel = std::clamp(number, 0, 9);
+        } else if (key == "--mips") {
+            if (!nextNumber(number)) return false;
+            args.mipLevels = std::clamp(number, 0, 12);
+        } else if (key == "--batch") {
+            if (!next(args.batchFile)) return false;
+        } else if (key == "--cache-dir") {
+            if (!next(args.cacheDir)) return false;
+        } else if (key == "--no-cache") {
+            args.noCache = true;
+        } else if (key == "--render-cache") {
+            args.renderCache = true;
+        } else if (key == "--memory-report") {
+            args.memoryReport = true;
+        } else if (key == "--profile") {
+            args.profile = true;
+        } else if (key == "--stats-json") {
+            if (!next(args.statsJsonPath)) return false;
+            args.profile = true;
+        } else if (key == "--iterations") {
+            if (!nextNumber(number)) return false;
+            args.iterations = std::max(1, number);
+        } else if (key == "--threads") {
+            if (!nextNumber(number)) return false;
+            args.threads = static_cast<unsigned>(std::max(0, number));
+        } else if (key == "--serve") {
+            args.serve = true;
+        } else if (key == "--verbose") {
+            args.verbose = true;
+        } else {
+            return false;
+        }
+    }
+
+    if (args.dataRoot.empty()) {
+        return false;
+    }
+
+    if (args.jobs.empty() && args.batchFile.empty() && !args.serve && args.command.empty()) {
+        return false;
+    }
+
+    if (args.command == "bench" && args.jobs.size() != 1) {
+        return false;
+    }
+
+    if (args.command == "morphs" && args.outDir.empty()) {
+        return false;
+    }
+
+    if (args.command == "bodygen" && (args.rulesPath.empty() || args.outDir.empty())) {
+        return false;
+    }
+
+    std::vector<ViewAngles> views;
+    if (!ParseViewSpec(args.viewSpec, {args.yawDeg, args.pitchDeg, args.rollDeg}, views)) {
+        std::cerr << "Invalid --views spec: " << args.viewSpec << "\n";
+        return false;
+    }
+    if (args.sheet && !SheetFits(args, views.size())) {
+        std::cerr << "Sprite sheet too large: " << views.size() << " views of " << args.size << "px exceed "
+                  << kMaxSheetPixels << " pixels\n";
+        return false;
+    }
+
+    for (const auto& job : args.jobs) {
+        if (job.presetName.empty() || (job.outPath.empty() && args.command.empty())) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool LoadBatchFile(const fs::path& file, std::vector<RenderJob>& outJobs) {
+    std::ifstream in(file);
+    if (!in) return false;
+
+    std::string line;
+    size_t lineNo = 0;
+    while (std::getline(in, line)) {
+        lineNo++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+
+        std::vector<std::string> cols;
+        size_t start = 0;
+        while (true) {
+            size_t tab = line.find('\t', start);
+            cols.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+            if (tab == std::string::npos) break;
+            start = tab + 1;
+        }
+
+        if (cols.size() < 2 || cols[0].empty() || cols[1].empty()) {
+            std::cerr << "Invalid batch line " << lineNo << " in " << file.string() << "\n";
+            return false;
+        }
+
+        RenderJob job;
+        job.presetName = cols[0];
+        job.outPath = cols[1];
+        if (cols.size() > 2) job.exportGlbPath = cols[2];
+        if (cols.size() > 3) job.presetFile = cols[3];
+        outJobs.push_back(std::move(job));
+    }
+
+    return true;
+}
+
+static void AppendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+struct JsonScalar {
+    std::string text;
+    bool isString = false;
+};
+
+using JsonFields = std::unordered_map<std::string, JsonScalar>;
+
+static std::string JsonEscape(const std::string& in) {
+    std::string out;
+    out.reserve(in.size() + 2);
+    for (char c : in) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(c)));
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out;
+}
+
+std::string JsonQuote(const std::string& in) {
+    return "\"" + JsonEscape(in) + "\"";
+}
+
+// Parses a flat JSON object whose values are strings, numbers, booleans or null.
+static bool ParseJsonObject(const std::string& text, JsonFields& out) {
+    size_t i = 0;
+    auto skipWs = [&]() {
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) ++i;
+    };
+    auto parseHex4 = [&](size_t at, uint32_t& value) -> bool {
+        if (at + 4 > text.size()) return false;
+        value = 0;
+        for (size_t k = at; k < at + 4; ++k) {
+            const char c = text[k];
+            if (!std::isxdigit(static_cast<unsigned char>(c))) return false;
+            value = value * 16 + static_cast<uint32_t>(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+        }
+        return true;
+    };
+    auto parseString = [&](std::string& str) -> bool {
+        if (i >= text.size() || text[i] != '"') return false;
+        ++i;
+        while (i < text.size() && text[i] != '"') {
+            char c = text[i++];
+            if (c != '\\') {
+                str += c;
+                continue;
+            }
+            if (i >= text.size()) return false;
+            char e = text[i++];
+            switch (e) {
+            case 'n': str += '\n'; break;
+            case 'r': str += '\r'; break;
+            case 't': str += '\t'; break;
+            case 'b': str += '\b'; break;
+            case 'f': str += '\f'; break;
+            case 'u': {
+                uint32_t cp = 0;
+                if (!parseHex4(i, cp)) return false;
+                i += 4;
+                if (cp >= 0xDC00 && cp <= 0xDFFF) return false;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    // A high surrogate must be followed by an escaped low surrogate.
+                    uint32_t lo = 0;
+                    if (i + 2 > text.size() || text[i] != '\\' || text[i + 1] != 'u' || !parseHex4(i + 2, lo)) {
+                        return false;
+                    }
+                    if (lo < 0xDC00 || lo > 0xDFFF) return false;
+                    i += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                AppendUtf8(str, cp);
+                break;
+            }
+            case '"':
+            case '\\':
+            case '/': str += e; break;
+            default: return false;
+            }
+        }
+        if (i >= text.size()) return false;
+        ++i;
+        return true;
+    };
+
+    skipWs();
+    if (i >= text.size() || text[i] != '{') return false;
+    ++i;
+    skipWs();
+    if (i < text.size() && text[i] == '}') return true;
+
+    while (i < text.size()) {
+        skipWs();
+        std::string key;
+        if (!parseString(key)) return false;
+        skipWs();
+        if (i >= text.size() || text[i] != ':') return false;
+        ++i;
+        skipWs();
+
+        JsonScalar value;
+        if (i < text.size() && text[i] == '"') {
+            if (!parseString(value.text)) return false;
+            value.isString = true;
+        } else {
+            size_t start = i;
+            while (i < text.size() && text[i] != ',' && text[i] != '}' && !std::isspace(static_cast<unsigned char>(text[i]))) ++i;
+            value.text = text.substr(start, i - start);
+            if (value.text.empty() || value.text[0] == '{' || value.text[0] == '[') return false;
+            if (value.text == "null") value.text.clear();
+        }
+        out[key] = std::move(value);
+
+        skipWs();
+        if (i >= text.size()) return false;
+        if (text[i] == '}') return true;
+        if (text[i] != ',') return false;
+        ++i;
+    }
+
+    return false;
+}
+
+// Parses an XML file, counting its size as read for --profile.
+static bool LoadXmlFile(XMLDocument& doc, const fs::path& file) {
+    if (doc.LoadFile(file.string().c_str()) != tinyxml2::XML_SUCCESS) return false;
+    std::error_code ec;
+    const auto size = fs::file_size(file, ec);
+    if (!ec) ProfileBytesRead(size);
+    return true;
+}
+
+static bool ReadPresetElement(const XMLElement* presetElem, Preset& outPreset) {
+    const char* nameAttr = presetElem->Attribute("name");
+    const char* setAttr = presetElem->Attribute("set");
+    if (!nameAttr || !setAttr) return false;
+
+    outPreset.name = nameAttr;
+    outPreset.setName = setAttr;
+
+    for (auto* setSlider = presetElem->FirstChildElement("SetSlider"); setSlider; setSlider = setSlider->NextSiblingElement("SetSlider")) {
+        const char* sliderName = setSlider->Attribute("name");
+        const char* sizeAttr = setSlider->Attribute("size");
+        if (!sliderName || !sizeAttr) continue;
+        float value = setSlider->FloatAttribute("value") / 100.0f;
+
+        std::string size = sizeAttr;
+        if (size == "big") {
+            outPreset.big[sliderName] = value;
+        } else if (size == "small") {
+            outPreset.small[sliderName] = value;
+        } else if (size == "both") {
+            outPreset.big[sliderName] = value;
+            outPreset.small[sliderName] = value;
+        }
+    }
+
+    return true;
+}
+
+bool LoadPresetFromFile(const fs::path& file, const std::string& presetName, Preset& outPreset) {
+    XMLDocument doc;
+    if (!LoadXmlFile(doc, file)) {
+        return false;
+    }
+
+    auto* root = doc.FirstChildElement("SliderPresets");
+    if (!root) return false;
+
+    for (auto* presetElem = root->FirstChildElement("Preset"); presetElem; presetElem = presetElem->NextSiblingElement("Preset")) {
+        const char* nameAttr = presetElem->Attribute("name");
+        if (!nameAttr) continue;
+        if (presetName != nameAttr) continue;
+
+        return ReadPresetElement(presetElem, outPreset);
+    }
+
+    return false;
+}
+
+static bool ReadFileBytes(const fs::path& file, std::string& out) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) return false;
+    in.seekg(0, std::ios::end);
+    std::streamoff size = in.tellg();
+    if (size < 0) return false;
+    in.seekg(0, std::ios::beg);
+    out.resize(static_cast<size_t>(size));
+    in.read(out.data(), size);
+    ProfileBytesRead(static_cast<uint64_t>(in.gcount()));
+    return in.good() || in.eof();
+}
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+        if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+        if (fd_ >= 0) close(fd_);
+#endif
+    }
+
+    bool Open(const fs::path& path) {
+#ifdef _WIN32
+        file_ = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) return false;
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) return false;
+        data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        size_ = static_cast<size_t>(size.QuadPart);
+#else
+        fd_ = open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) return false;
+        struct stat st;
+        if (fstat(fd_, &st) != 0 || st.st_size == 0) return false;
+        void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapped == MAP_FAILED) return false;
+        data_ = static_cast<const uint8_t*>(mapped);
+        size_ = static_cast<size_t>(st.st_size);
+#endif
+        if (data_) ProfileBytesRead(size_);
+        return data_ != nullptr;
+    }
+
+    const uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+private:
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Fixed set of worker threads. ParallelFor hands out indices from a shared
+// counter and the calling thread works alongside the pool, so with one thread
+// everything runs inline. Tasks must not call ParallelFor themselves.
+// Process-wide pool sized by --threads on first use.
+ThreadPool& WorkerPool() {
+    static ThreadPool pool(gThreadCount ? gThreadCount : std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+// Forward-only XML tokenizer. Reports element start/end tags with decoded
+// attributes and byte offsets; text, comments, processing instructions,
+// CDATA and DOCTYPE sections are skipped.
+class XmlScanner {
+public:
+    enum class Token { StartTag, EndTag, End, Error };
+
+    XmlScanner(const char* data, size_t size) : data_(data), size_(size) {}
+
+    Token Next() {
+        attrs_.clear();
+        selfClosing_ = false;
+        while (pos_ < size_) {
+            const char* lt = static_cast<const char*>(std::memchr(data_ + pos_, '<', size_ - pos_));
+            if (!lt) {
+                pos_ = size_;
+                break;
+            }
+            pos_ = static_cast<size_t>(lt - data_);
+            tagBegin_ = pos_;
+
+            if (StartsWith("<!--")) {
+                if (!SkipPast("-->")) return Token::Error;
+                continue;
+            }
+            if (StartsWith("<![CDATA[")) {
+                if (!SkipPast("]]>")) return Token::Error;
+                continue;
+            }
+            if (StartsWith("<?") || StartsWith("<!")) {
+                if (!SkipPast(">")) return Token::Error;
+                continue;
+            }
+
+            ++pos_;
+            bool endTag = pos_ < size_ && data_[pos_] == '/';
+            if (endTag) ++pos_;
+
+            size_t nameStart = pos_;
+            while (pos_ < size_ && !IsSpace(data_[pos_]) && data_[pos_] != '>' && data_[pos_] != '/') ++pos_;
+            name_.assign(data_ + nameStart, pos_ - nameStart);
+            if (name_.empty()) return Token::Error;
+
+            while (true) {
+                while (pos_ < size_ && IsSpace(data_[pos_])) ++pos_;
+                if (pos_ >= size_) return Token::Error;
+                char c = data_[pos_];
+                if (c == '>') {
+                    ++pos_;
+                    break;
+                }
+                if (c == '/') {
+                    selfClosing_ = true;
+                    ++pos_;
+                    continue;
+                }
+
+                size_t attrStart = pos_;
+                while (pos_ < size_ && data_[pos_] != '=' && !IsSpace(data_[pos_]) && data_[pos_] != '>') ++pos_;
+                std::string attrName(data_ + attrStart, pos_ - attrStart);
+                while (pos_ < size_ && IsSpace(data_[pos_])) ++pos_;
+                if (pos_ >= size_ || data_[pos_] != '=') return Token::Error;
+                ++pos_;
+                while (pos_ < size_ && IsSpace(data_[pos_])) ++pos_;
+                if (pos_ >= size_ || (data_[pos_] != '"' && data_[pos_] != '\'')) return Token::Error;
+                char quote = data_[pos_++];
+                size_t valueStart = pos_;
+                const char* close = static_cast<const char*>(std::memchr(data_ + pos_, quote, size_ - pos_));
+                if (!close) return Token::Error;
+                pos_ = static_cast<size_t>(close - data_);
+                attrs_.emplace_back(std::move(attrName), DecodeEntities(data_ + valueStart, pos_ - valueStart));
+                ++pos_;
+            }
+
+            tagEnd_ = pos_;
+            return endTag ? Token::EndTag : Token::StartTag;
+        }
+        return Token::End;
+    }
+
+    const std::string& Name() const { return name_; }
+    bool SelfClosing() const { return selfClosing_; }
+    size_t TagBegin() const { return tagBegin_; }
+    size_t TagEnd() const { return tagEnd_; }
+    const std::vector<std::pair<std::string, std::string>>& Attributes() const { return attrs_; }
+
+    // Decoded, whitespace-trimmed character data following the last start tag.
+    std::string Text() const {
+        const char* lt = static_cast<const char*>(std::memchr(data_ + tagEnd_, '<', size_ - tagEnd_));
+        size_t end = lt ? static_cast<size_t>(lt - data_) : size_;
+        size_t begin = tagEnd_;
+        while (begin < end && IsSpace(data_[begin])) ++begin;
+        while (end > begin && IsSpace(data_[end - 1])) --end;
+        return DecodeEntities(data_ + begin, end - begin);
+    }
+
+    const std::string* Attribute(const char* name) const {
+        for (const auto& attr : attrs_) {
+            if (attr.first == name) return &attr.second;
+        }
+        return nullptr;
+    }
+
+    static std::string DecodeEntities(const char* p, size_t len) {
+        std::string out;
+        out.reserve(len);
+        for (size_t i = 0; i < len; ++i) {
+            if (p[i] != '&') {
+                out += p[i];
+                continue;
+            }
+            const char* semi = static_cast<const char*>(std::memchr(p + i, ';', len - i));
+            if (!semi) {
+                out += p[i];
+                continue;
+            }
+            std::string ent(p + i + 1, semi);
+            if (ent == "amp") out += '&';
+            else if (ent == "lt") out += '<';
+            else if (ent == "gt") out += '>';
+            else if (ent == "quot") out += '"';
+            else if (ent == "apos") out += '\'';
+            else if (!ent.empty() && ent[0] == '#') {
+                uint32_t cp = ent.size() > 1 && (ent[1] == 'x' || ent[1] == 'X')
+                    ? static_cast<uint32_t>(std::strtoul(ent.c_str() + 2, nullptr, 16))
+                    : static_cast<uint32_t>(std::strtoul(ent.c_str() + 1, nullptr, 10));
+                AppendUtf8(out, cp);
+            } else {
+                out.append(p + i, semi + 1);
+            }
+            i = static_cast<size_t>(semi - p);
+        }
+        return out;
+    }
+
+private:
+    static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+    bool StartsWith(const char* prefix) const {
+        size_t len = std::strlen(prefix);
+        return size_ - pos_ >= len && std::memcmp(data_ + pos_, prefix, len) == 0;
+    }
+
+    bool SkipPast(const char* terminator) {
+        size_t len = std::strlen(terminator);
+        for (size_t i = pos_; i + len <= size_; ++i) {
+            if (std::memcmp(data_ + i, terminator, len) == 0) {
+                pos_ = i + len;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    size_t tagBegin_ = 0;
+    size_t tagEnd_ = 0;
+    bool selfClosing_ = false;
+    std::string name_;
+    std::vector<std::pair<std::string, std::string>> attrs_;
+};
+
+static uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static std::string HashHex(uint64_t hash) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+    return buf;
+}
+
+static int64_t FileTimeToInt(fs::file_time_type time) {
+    return static_cast<int64_t>(time.time_since_epoch().count());
+}
+
+// Little helpers for the versioned binary cache files kept under --cache-dir.
+class BinaryWriter {
+public:
+    template <typename T>
+    void Put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "POD only");
+        buffer_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void PutString(const std::string& value) {
+        Put(static_cast<uint32_t>(value.size()));
+        buffer_.append(value);
+    }
+
+    void PutBytes(const void* data, size_t size) {
+        buffer_.append(static_cast<const char*>(data), size);
+    }
+
+    void Align(size_t alignment) {
+        buffer_.resize((buffer_.size() + alignment - 1) / alignment * alignment, '\0');
+    }
+
+    size_t Size() const { return buffer_.size(); }
+
+    const std::string& Data() const { return buffer_; }
+
+    // Writes to a temporary file and renames it over the target so concurrent
+    // readers never observe a partially written cache.
+    bool Save(const fs::path& file) const {
+        std::error_code ec;
+        fs::create_directories(file.parent_path(), ec);
+        fs::path tmp = file;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+            out.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+            if (!out.good()) return false;
+        }
+        fs::rename(tmp, file, ec);
+        if (ec) {
+            fs::remove(tmp, ec);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::string buffer_;
+};
+
+class BinaryReader {
+public:
+    explicit BinaryReader(const std::string& data) : data_(data.data()), size_(data.size()) {}
+    BinaryReader(const void* data, size_t size) : data_(static_cast<const char*>(data)), size_(size) {}
+
+    template <typename T>
+    bool Get(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "POD only");
+        if (size_ - pos_ < sizeof(T)) return ok_ = false;
+        std::memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return true;
+    }
+
+    bool GetString(std::string& value) {
+        uint32_t len = 0;
+        if (!Get(len)) return false;
+        if (size_ - pos_ < len) return ok_ = false;
+        value.assign(data_ + pos_, len);
+        pos_ += len;
+        return true;
+    }
+
+    bool Ok() const { return ok_; }
+    bool AtEnd() const { return pos_ == size_; }
+
+private:
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+struct PresetIndexEntry {
+    std::string name;
+    std::string setName;
+    // SetSlider values as written in the file (0-100 scale), in document
+    // order; size="both" adds to both lists.
+    std::vector<std::pair<std::string, float>> big;
+    std::vector<std::pair<std::string, float>> small;
+};
+
+// Same result as ReadPresetElement on the element the entry was scanned from.
+static void PresetFromIndexEntry(const PresetIndexEntry& entry, Preset& outPreset) {
+    outPreset.name = entry.name;
+    outPreset.setName = entry.setName;
+    for (const auto& slider : entry.big) outPreset.big[slider.first] = slider.second / 100.0f;
+    for (const auto& slider : entry.small) outPreset.small[slider.first] = slider.second / 100.0f;
+}
+
+struct PresetIndexFile {
+    int64_t mtime = -1;
+    uint64_t size = 0;
+    std::vector<PresetIndexEntry> entries;
+};
+
+// Extracts name, set and slider values of every top-level <Preset> in a preset
+// file in one streaming pass, without building a DOM.
+static bool ScanPresetFile(const fs::path& file, std::vector<PresetIndexEntry>& outEntries) {
+    std::string xml;
+    if (!ReadFileBytes(file, xml)) return false;
+
+    XmlScanner scanner(xml.data(), xml.size());
+    int depth = 0;
+    bool inRoot = false;
+    bool open = false; // inside a <Preset> that was added to outEntries
+
+    for (auto token = scanner.Next(); token != XmlScanner::Token::End; token = scanner.Next()) {
+        if (token == XmlScanner::Token::Error) return false;
+
+        if (token == XmlScanner::Token::StartTag) {
+            if (depth == 0) {
+                if (inRoot || scanner.Name() != "SliderPresets") return !outEntries.empty();
+                inRoot = true;
+            } else if (depth == 1 && scanner.Name() == "Preset") {
+                const std::string* name = scanner.Attribute("name");
+                const std::string* set = scanner.Attribute("set");
+                if (name && set) {
+                    PresetIndexEntry entry;
+                    entry.name = *name;
+                    entry.setName = *set;
+                    outEntries.push_back(std::move(entry));
+                    open = !scanner.SelfClosing();
+                }
+            } else if (depth == 2 && open && scanner.Name() == "SetSlider") {
+                const std::string* sliderName = scanner.Attribute("name");
+                const std::string* size = scanner.Attribute("size");
+                if (sliderName && size) {
+                    const std::string* valueAttr = scanner.Attribute("value");
+                    const float value = valueAttr ? std::strtof(valueAttr->c_str(), nullptr) : 0.0f;
+                    PresetIndexEntry& entry = outEntries.back();
+                    if (*size == "big" || *size == "both") entry.big.emplace_back(*sliderName, value);
+                    if (*size == "small" || *size == "both") entry.small.emplace_back(*sliderName, value);
+                }
+            }
+            if (!scanner.SelfClosing()) depth++;
+        } else {
+            depth--;
+            if (depth == 1) open = false;
+            if (depth < 0) return false;
+        }
+    }
+
+    return true;
+}
+
+// Snapshot of a directory tree (relative directories with their mtimes and the
+// accepted files below them). Refresh() only relists directories whose mtime
+// changed, since adding, removing or renaming an entry updates its parent.
+class DirectoryTree {
+public:
+    using Filter = bool (*)(const fs::path& file);
+
+    std::map<std::string, int64_t> dirs; // relative dir ("" = root) -> mtime
+    std::set<std::string> files;         // relative file paths
+
+    // Returns true if the file set changed.
+    bool Refresh(const fs::path& root, Filter accept) {
+        std::error_code ec;
+        if (!fs::is_directory(root, ec)) {
+            bool hadData = !dirs.empty() || !files.empty();
+            dirs.clear();
+            files.clear();
+            return hadData;
+        }
+
+        std::vector<std::string> pending;
+        std::vector<std::string> removed;
+        if (dirs.empty()) pending.push_back(std::string());
+        for (const auto& dir : dirs) {
+            auto mtime = fs::last_write_time(PathOf(root, dir.first), ec);
+            if (ec) {
+                removed.push_back(dir.first);
+            } else if (FileTimeToInt(mtime) != dir.second) {
+                pending.push_back(dir.first);
+            }
+        }
+
+        bool changed = !removed.empty();
+        for (const auto& dir : removed) EraseSubtree(dir);
+
+        while (!pending.empty()) {
+            std::string rel = std::move(pending.back());
+            pending.pop_back();
+            fs::path path = PathOf(root, rel);
+
+            auto mtime = fs::last_write_time(path, ec);
+            if (ec) {
+                EraseSubtree(rel);
+                changed = true;
+                continue;
+            }
+            dirs[rel] = FileTimeToInt(mtime);
+
+            std::set<std::string> seenDirs;
+            std::set<std::string> seenFiles;
+            for (auto& entry : fs::directory_iterator(path, ec)) {
+                std::string childRel = entry.path().lexically_relative(root).generic_u8string();
+                std::error_code typeEc;
+                if (entry.is_directory(typeEc)) {
+                    seenDirs.insert(childRel);
+                    if (!dirs.count(childRel)) pending.push_back(childRel);
+                } else if (entry.is_regular_file(typeEc) && accept(entry.path())) {
+                    seenFiles.insert(childRel);
+                    changed |= files.insert(childRel).second;
+                }
+            }
+
+            for (auto it = files.begin(); it != files.end();) {
+                if (ParentOf(*it) == rel && !seenFiles.count(*it)) {
+                    it = files.erase(it);
+                    changed = true;
+                } else {
+                    ++it;
+                }
+            }
+            std::vector<std::string> goneDirs;
+            for (const auto& dir : dirs) {
+                if (!dir.first.empty() && ParentOf(dir.first) == rel && !seenDirs.count(dir.first)) {
+                    goneDirs.push_back(dir.first);
+                }
+            }
+            for (const auto& dir : goneDirs) {
+                EraseSubtree(dir);
+                changed = true;
+            }
+        }
+
+        return changed;
+    }
+
+    void Write(BinaryWriter& writer) const {
+        writer.Put(static_cast<uint32_t>(dirs.size()));
+        for (const auto& dir : dirs) {
+            writer.PutString(dir.first);
+            writer.Put(dir.second);
+        }
+        writer.Put(static_cast<uint32_t>(files.size()));
+        for (const auto& file : files) {
+            writer.PutString(file);
+        }
+    }
+
+    bool Read(BinaryReader& reader) {
+        uint32_t dirCount = 0;
+        reader.Get(dirCount);
+        for (uint32_t i = 0; i < dirCount && reader.Ok(); ++i) {
+            std::string rel;
+            int64_t mtime = 0;
+            reader.GetString(rel);
+            reader.Get(mtime);
+            dirs[rel] = mtime;
+        }
+        uint32_t fileCount = 0;
+        reader.Get(fileCount);
+        for (uint32_t i = 0; i < fileCount && reader.Ok(); ++i) {
+            std::string rel;
+            reader.GetString(rel);
+            files.insert(std::move(rel));
+        }
+        return reader.Ok();
+    }
+
+    static fs::path PathOf(const fs::path& root, const std::string& rel) {
+        return rel.empty() ? root : root / fs::u8path(rel);
+    }
+
+    static std::string ParentOf(const std::string& rel) {
+        size_t slash = rel.find_last_of('/');
+        return slash == std::string::npos ? std::string() : rel.substr(0, slash);
+    }
+
+private:
+    static bool IsUnder(const std::string& rel, const std::string& dir) {
+        if (dir.empty()) return true;
+        return rel.size() > dir.size() && rel.compare(0, dir.size(), dir) == 0 && rel[dir.size()] == '/';
+    }
+
+    void EraseSubtree(const std::string& dir) {
+        for (auto it = dirs.begin(); it != dirs.end();) {
+            it = (it->first == dir || IsUnder(it->first, dir)) ? dirs.erase(it) : std::next(it);
+        }
+        for (auto it = files.begin(); it != files.end();) {
+            it = IsUnder(*it, dir) ? files.erase(it) : std::next(it);
+        }
+    }
+};
+
+// Persistent name -> (file, set, slider values) index over SliderPresets.
+// Directory mtimes decide which directories need relisting, file mtime/size
+// decide which files need rescanning. A warm lookup is one hash probe; the hit
+// is built from the entry by PresetFromIndexEntry without parsing the file.
+class PresetIndex {
+public:
+    void Open(const fs::path& presetsDir, const fs::path& indexFile) {
+        root_ = presetsDir;
+        indexFile_ = indexFile;
+        if (!indexFile_.empty()) Load();
+        Revalidate();
+    }
+
+    void Revalidate() {
+        size_t rescanned = 0;
+        bool changed = tree_.Refresh(root_, [](const fs::path& file) { return file.extension() == ".xml"; });
+
+        for (auto it = files_.begin(); it != files_.end();) {
+            if (tree_.files.count(it->first)) {
+                ++it;
+            } else {
+                it = files_.erase(it);
+            }
+        }
+
+        std::vector<std::pair<fs::path, PresetIndexFile*>> rescan;
+        for (const auto& rel : tree_.files) {
+            PresetIndexFile& indexed = files_[rel];
+            fs::path file = root_ / fs::u8path(rel);
+            std::error_code ec;
+            auto mtime = fs::last_write_time(file, ec);
+            uintmax_t size = ec ? 0 : fs::file_size(file, ec);
+            if (ec) continue;
+            if (FileTimeToInt(mtime) != indexed.mtime || size != indexed.size) {
+                indexed.mtime = FileTimeToInt(mtime);
+                indexed.size = size;
+                indexed.entries.clear();
+                rescan.emplace_back(std::move(file), &indexed);
+            }
+        }
+
+        // Files are independent; scan them in parallel, one task per file.
+        std::vector<char> scanned(rescan.size(), 0);
+        WorkerPool().ParallelFor(rescan.size(), [&](size_t i) {
+            scanned[i] = ScanPresetFile(rescan[i].first, rescan[i].second->entries);
+        });
+        for (size_t i = 0; i < rescan.size(); ++i) {
+            if (!scanned[i] && gVerbose) {
+                std::cerr << "Failed to scan preset file: " << rescan[i].first.string() << "\n";
+            }
+        }
+        rescanned = rescan.size();
+        changed |= !rescan.empty();
+
+        if (changed || byName_.empty()) RebuildNames();
+        if (changed && !indexFile_.empty() && !Save() && gVerbose) {
+            std::cerr << "Failed to write preset index: " << indexFile_.string() << "\n";
+        }
+        if (gVerbose) {
+            std::cerr << "Preset index: " << byName_.size() << " presets in " << files_.size()
+                      << " files, rescanned " << rescanned << "\n";
+        }
+    }
+
+    bool Find(const std::string& presetName, fs::path& outFile, const PresetIndexEntry*& outEntry) const {
+        auto it = byName_.find(presetName);
+        if (it == byName_.end()) return false;
+        outFile = root_ / fs::u8path(it->second.first);
+        outEntry = it->second.second;
+        return true;
+    }
+
+    // True when the file still has the mtime and size it was scanned with.
+    bool IsCurrent(const fs::path& file) const {
+        auto it = files_.find(file.lexically_relative(root_).generic_u8string());
+        if (it == files_.end()) return false;
+        std::error_code ec;
+        auto mtime = fs::last_write_time(file, ec);
+        uintmax_t size = ec ? 0 : fs::file_size(file, ec);
+        return !ec && FileTimeToInt(mtime) == it->second.mtime && size == it->second.size;
+    }
+
+    // Relists every directory, even ones whose mtime looks unchanged, and
+    // rescans the files whose stamps moved.
+    void Refresh() {
+        tree_ = DirectoryTree();
+        Revalidate();
+    }
+
+    template <typename Fn>
+    void ForEach(Fn&& fn) const {
+        for (const auto& file : files_) {
+            for (const auto& entry : file.second.entries) {
+                fn(root_ / fs::u8path(file.first), entry);
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x49505342; // 'BSPI'
+    static constexpr uint32_t kVersion = 3;
+
+    static void GetSliders(BinaryReader& reader, std::vector<std::pair<std::string, float>>& out) {
+        uint32_t count = 0;
+        reader.Get(count);
+        for (uint32_t i = 0; i < count && reader.Ok(); ++i) {
+            std::pair<std::string, float> slider;
+            reader.GetString(slider.first);
+            reader.Get(slider.second);
+            out.push_back(std::move(slider));
+        }
+    }
+
+    static void PutSliders(BinaryWriter& writer, const std::vector<std::pair<std::string, float>>& sliders) {
+        writer.Put(static_cast<uint32_t>(sliders.size()));
+        for (const auto& slider : sliders) {
+            writer.PutString(slider.first);
+            writer.Put(slider.second);
+        }
+    }
+
+    void RebuildNames() {
+        byName_.clear();
+        for (const auto& file : files_) {
+            for (const auto& entry : file.second.entries) {
+                byName_.emplace(entry.name, std::make_pair(file.first, &entry));
+            }
+        }
+    }
+
+    void Load() {
+        std::string data;
+        if (!ReadFileBytes(indexFile_, data)) return;
+
+        BinaryReader reader(data);
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        std::string root;
+        reader.Get(magic);
+        reader.Get(version);
+        reader.GetString(root);
+        if (!reader.Ok() || magic != kMagic || version != kVersion || root != root_.generic_u8string()) return;
+
+        DirectoryTree tree;
+        tree.Read(reader);
+        std::map<std::string, PresetIndexFile> files;
+        for (const auto& rel : tree.files) {
+            PresetIndexFile file;
+            uint32_t entryCount = 0;
+            reader.Get(file.mtime);
+            reader.Get(file.size);
+            reader.Get(entryCount);
+            for (uint32_t e = 0; e < entryCount && reader.Ok(); ++e) {
+                PresetIndexEntry entry;
+                reader.GetString(entry.name);
+                reader.GetString(entry.setName);
+                GetSliders(reader, entry.big);
+                GetSliders(reader, entry.small);
+                file.entries.push_back(std::move(entry));
+            }
+            if (!reader.Ok()) return;
+            files[rel] = std::move(file);
+        }
+
+        if (!reader.Ok() || !reader.AtEnd()) return;
+        tree_ = std::move(tree);
+        files_ = std::move(files);
+    }
+
+    bool Save() const {
+        BinaryWriter writer;
+        writer.Put(kMagic);
+        writer.Put(kVersion);
+        writer.PutString(root_.generic_u8string());
+        tree_.Write(writer);
+        for (const auto& rel : tree_.files) {
+            const PresetIndexFile& file = files_.at(rel);
+            writer.Put(file.mtime);
+            writer.Put(file.size);
+            writer.Put(static_cast<uint32_t>(file.entries.size()));
+            for (const auto& entry : file.entries) {
+                writer.PutString(entry.name);
+                writer.PutString(entry.setName);
+                PutSliders(writer, entry.big);
+                PutSliders(writer, entry.small);
+            }
+        }
+        return writer.Save(indexFile_);
+    }
+
+    fs::path root_;
+    fs::path indexFile_;
+    DirectoryTree tree_;
+    std::map<std::string, PresetIndexFile> files_; // relative file -> scanned presets
+    std::unordered_map<std::string, std::pair<std::string, const PresetIndexEntry*>> byName_;
+};
+
+static bool FindPreset(const fs::path& presetsDir, const std::string& presetName, const std::string& presetFile,
+                       PresetIndex* index, Preset& outPreset) {
+    if (!presetFile.empty()) {
+        return LoadPresetFromFile(presetFile, presetName, outPreset);
+    }
+
+    // The index comes revalidated from the session, so a miss is final. An entry
+    // is trusted only while its file is unchanged; a stale one falls back to
+    // scanning the XML and then refreshes the index.
+    if (index) {
+        fs::path file;
+        const PresetIndexEntry* entry = nullptr;
+        if (!index->Find(presetName, file, entry)) return false;
+        if (index->IsCurrent(file)) {
+            PresetFromIndexEntry(*entry, outPreset);
+            return true;
+        }
+    }
+
+    bool found = false;
+    if (fs::exists(presetsDir)) {
+        for (auto& entry : fs::recursive_directory_iterator(presetsDir)) {
+            if (!entry.is_regular_file()) continue;
+            if (entry.path().extension() != ".xml") continue;
+            if (LoadPresetFromFile(entry.path(), presetName, outPreset)) {
+                found = true;
+                break;
+            }
+        }
+    }
+
+    if (index) index->Refresh();
+    return found;
+}
+
+static void ReadSliderSetElement(const XMLElement* setElem, const fs::path& file, SliderSet& outSet) {
+    outSet.name = setElem->Attribute("name");
+    outSet.ospFile = file;
+
+    auto* dataFolder = setElem->FirstChildElement("DataFolder");
+    if (dataFolder && dataFolder->GetText()) outSet.dataFolder = dataFolder->GetText();
+
+    auto* sourceFile = setElem->FirstChildElement("SourceFile");
+    if (sourceFile && sourceFile->GetText()) outSet.sourceFile = sourceFile->GetText();
+
+    for (auto* shape = setElem->FirstChildElement("Shape"); shape; shape = shape->NextSiblingElement("Shape")) {
+        const char* targetAttr = shape->Attribute("target");
+        const char* text = shape->GetText();
+        if (!targetAttr || !text) continue;
+        outSet.shapes.emplace_back(text, targetAttr);
+    }
+
+    for (auto* sliderElem = setElem->FirstChildElement("Slider"); sliderElem; sliderElem = sliderElem->NextSiblingElement("Slider")) {
+        Slider s;
+        const char* sliderName = sliderElem->Attribute("name");
+        if (!sliderName) continue;
+        s.name = sliderName;
+        s.invert = sliderElem->BoolAttribute("invert", false);
+        s.clamp = sliderElem->BoolAttribute("clamp", false);
+        s.zap = sliderElem->BoolAttribute("zap", false);
+        s.uv = sliderElem->BoolAttribute("uv", false);
+        s.defaultValue = sliderElem->FloatAttribute("default", 0.0f) / 100.0f;
+
+        for (auto* dataElem = sliderElem->FirstChildElement("Data"); dataElem; dataElem = dataElem->NextSiblingElement("Data")) {
+            const char* dataName = dataElem->Attribute("name");
+            const char* targetName = dataElem->Attribute("target");
+            const char* text = dataElem->GetText();
+            if (!dataName || !targetName || !text) continue;
+
+            SliderDataFile ddf;
+            ddf.dataName = dataName;
+            ddf.targetName = targetName;
+            ddf.fileName = text;
+            ddf.local = dataElem->BoolAttribute("local", true);
+            s.dataFiles.push_back(std::move(ddf));
+        }
+
+        outSet.sliders.push_back(std::move(s));
+    }
+}
+
+bool LoadSliderSetFromFile(const fs::path& file, const std::string& setName, SliderSet& outSet) {
+    XMLDocument doc;
+    if (!LoadXmlFile(doc, file)) {
+        return false;
+    }
+
+    auto* root = doc.FirstChildElement("SliderSetInfo");
+    if (!root) return false;
+
+    for (auto* setElem = root->FirstChildElement("SliderSet"); setElem; setElem = setElem->NextSiblingElement("SliderSet")) {
+        const char* nameAttr = setElem->Attribute("name");
+        if (!nameAttr) continue;
+        if (setName != nameAttr) continue;
+
+        ReadSliderSetElement(setElem, file, outSet);
+        return true;
+    }
+
+    return false;
+}
+
+static bool FindSliderSetFile(const fs::path& sliderSetsDir, const std::string& setName, SliderSet& outSet) {
+    if (!fs::exists(sliderSetsDir)) return false;
+
+    for (auto& entry : fs::directory_iterator(sliderSetsDir)) {
+        if (!entry.is_regular_file()) continue;
+        if (entry.path().extension() != ".osp") continue;
+        if (LoadSliderSetFromFile(entry.path(), setName, outSet)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool LoadFirstSliderSet(const fs::path& sliderSetsDir, SliderSet& outSet) {
+    if (!fs::exists(sliderSetsDir)) return false;
+
+    for (auto& entry : fs::directory_iterator(sliderSetsDir)) {
+        if (!entry.is_regular_file()) continue;
+        if (entry.path().extension() != ".osp") continue;
+        XMLDocument doc;
+        if (!LoadXmlFile(doc, entry.path())) {
+            continue;
+        }
+        auto* root = doc.FirstChildElement("SliderSetInfo");
+        if (!root) continue;
+        auto* setElem = root->FirstChildElement("SliderSet");
+        if (!setElem) continue;
+        const char* nameAttr = setElem->Attribute("name");
+        if (!nameAttr) continue;
+        if (LoadSliderSetFromFile(entry.path(), nameAttr, outSet)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Catalog entry for one <SliderSet>: enough to resolve names and fallbacks
+// without touching the XML, plus the byte range to materialize it from.
+struct SliderSetInfo {
+    std::string name;
+    std::string dataFolder;
+    std::string sourceFile;
+    std::vector<std::pair<std::string, std::string>> shapes; // shapeName, targetName
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+struct SliderSetCatalogFile {
+    int64_t mtime = -1;
+    uint64_t size = 0;
+    std::vector<SliderSetInfo> sets;
+};
+
+static bool ScanSliderSetFile(const fs::path& file, std::vector<SliderSetInfo>& outSets) {
+    std::string xml;
+    if (!ReadFileBytes(file, xml)) return false;
+
+    XmlScanner scanner(xml.data(), xml.size());
+    int depth = 0;
+    SliderSetInfo* open = nullptr;
+
+    for (auto token = scanner.Next(); token != XmlScanner::Token::End; token = scanner.Next()) {
+        if (token == XmlScanner::Token::Error) return false;
+
+        if (token == XmlScanner::Token::StartTag) {
+            const std::string& name = scanner.Name();
+            if (depth == 0 && name != "SliderSetInfo") {
+                return false;
+            } else if (depth == 1 && name == "SliderSet") {
+                const std::string* setName = scanner.Attribute("name");
+                if (setName) {
+                    SliderSetInfo info;
+                    info.name = *setName;
+                    info.offset = static_cast<uint32_t>(scanner.TagBegin());
+                    info.length = static_cast<uint32_t>(scanner.TagEnd() - scanner.TagBegin());
+                    outSets.push_back(std::move(info));
+                    if (!scanner.SelfClosing()) open = &outSets.back();
+                }
+            } else if (depth == 2 && open) {
+                if (name == "DataFolder" && open->dataFolder.empty()) {
+                    open->dataFolder = scanner.Text();
+                } else if (name == "SourceFile" && open->sourceFile.empty()) {
+                    open->sourceFile = scanner.Text();
+                } else if (name == "Shape") {
+                    const std::string* target = scanner.Attribute("target");
+                    std::string shapeName = scanner.Text();
+                    if (target && !shapeName.empty()) open->shapes.emplace_back(shapeName, *target);
+                }
+            }
+            if (!scanner.SelfClosing()) depth++;
+        } else {
+            depth--;
+            if (depth == 1 && open) {
+                open->length = static_cast<uint32_t>(scanner.TagEnd() - open->offset);
+                open = nullptr;
+            }
+            if (depth < 0) return false;
+        }
+    }
+
+    return true;
+}
+
+// Persistent catalog of every slider set in SliderSets, keyed by set name and
+// invalidated per .osp by mtime/size. Only the set that is actually used gets
+// fully materialized, from its own byte range.
+class SliderSetCatalog {
+public:
+    void Open(const fs::path& sliderSetsDir, const fs::path& cacheFile) {
+        root_ = sliderSetsDir;
+        cacheFile_ = cacheFile;
+        if (!cacheFile_.empty()) Load();
+        Revalidate();
+    }
+
+    void Revalidate() {
+        std::error_code ec;
+        bool changed = false;
+        size_t rescanned = 0;
+        std::map<std::string, SliderSetCatalogFile> current;
+
+        for (auto& entry : fs::directory_iterator(root_, ec)) {
+            std::error_code entryEc;
+            if (!entry.is_regular_file(entryEc)) continue;
+            if (entry.path().extension() != ".osp") continue;
+
+            std::string fileName = entry.path().filename().u8string();
+            int64_t mtime = FileTimeToInt(entry.last_write_time(entryEc));
+            uint64_t size = entry.file_size(entryEc);
+
+            auto known = files_.find(fileName);
+            if (known != files_.end() && known->second.mtime == mtime && known->second.size == size) {
+                current.emplace(fileName, std::move(known->second));
+                continue;
+            }
+
+            SliderSetCatalogFile file;
+            file.mtime = mtime;
+            file.size = size;
+            if (!ScanSliderSetFile(entry.path(), file.sets) && gVerbose) {
+                std::cerr << "Failed to scan slider set file: " << entry.path().string() << "\n";
+            }
+            current.emplace(fileName, std::move(file));
+            rescanned++;
+            changed = true;
+        }
+
+        if (current.size() != files_.size()) changed = true;
+        files_ = std::move(current);
+
+        byName_.clear();
+        for (const auto& file : files_) {
+            for (const auto& set : file.second.sets) {
+                byName_.emplace(set.name, std::make_pair(file.first, &set));
+            }
+        }
+
+        if (changed && !cacheFile_.empty() && !Save() && gVerbose) {
+            std::cerr << "Failed to write slider set catalog: " << cacheFile_.string() << "\n";
+        }
+        if (gVerbose) {
+            std::cerr << "Slider set catalog: " << byName_.size() << " sets in " << files_.size()
+                      << " files, rescanned " << rescanned << "\n";
+        }
+    }
+
+    const SliderSetInfo* Find(const std::string& setName, fs::path& outFile) const {
+        auto it = byName_.find(setName);
+        if (it == byName_.end()) return nullptr;
+        outFile = root_ / fs::u8path(it->second.first);
+        return it->second.second;
+    }
+
+    // Forgets the scan of one .osp file and revalidates, so the file is parsed
+    // again. Pointers returned by Find and First are invalidated.
+    void Invalidate(const fs::path& ospFile) {
+        auto it = files_.find(ospFile.filename().u8string());
+        if (it != files_.end()) it->second.mtime = -1;
+        Revalidate();
+    }
+
+    const SliderSetInfo* First(fs::path& outFile) const {
+        for (const auto& file : files_) {
+            if (file.second.sets.empty()) continue;
+            outFile = root_ / fs::u8path(file.first);
+            return &file.second.sets.front();
+        }
+        return nullptr;
+    }
+
+    // Parses only the <SliderSet> element of the given catalog entry.
+    static bool Materialize(const fs::path& file, const SliderSetInfo& info, SliderSet& outSet) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) return false;
+        std::string xml(info.length, '\0');
+        in.seekg(info.offset);
+        in.read(xml.data(), info.length);
+        if (!in) return false;
+        ProfileBytesRead(info.length);
+
+        XMLDocument doc;
+        if (doc.Parse(xml.data(), xml.size()) != tinyxml2::XML_SUCCESS) return false;
+        auto* setElem = doc.FirstChildElement("SliderSet");
+        if (!setElem) return false;
+        const char* nameAttr = setElem->Attribute("name");
+        if (!nameAttr || info.name != nameAttr) return false;
+
+        outSet = SliderSet();
+        ReadSliderSetElement(setElem, file, outSet);
+        return true;
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x43535342; // 'BSSC'
+    static constexpr uint32_t kVersion = 1;
+
+    void Load() {
+        std::string data;
+        if (!ReadFileBytes(cacheFile_, data)) return;
+
+        BinaryReader reader(data);
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        std::string root;
+        reader.Get(magic);
+        reader.Get(version);
+        reader.GetString(root);
+        if (!reader.Ok() || magic != kMagic || version != kVersion || root != root_.generic_u8string()) return;
+
+        std::map<std::string, SliderSetCatalogFile> files;
+        uint32_t fileCount = 0;
+        reader.Get(fileCount);
+        for (uint32_t i = 0; i < fileCount && reader.Ok(); ++i) {
+            std::string fileName;
+            SliderSetCatalogFile file;
+            uint32_t setCount = 0;
+            reader.GetString(fileName);
+            reader.Get(file.mtime);
+            reader.Get(file.size);
+            reader.Get(setCount);
+            for (uint32_t s = 0; s < setCount && reader.Ok(); ++s) {
+                SliderSetInfo info;
+                uint32_t shapeCount = 0;
+                reader.GetString(info.name);
+                reader.GetString(info.dataFolder);
+                reader.GetString(info.sourceFile);
+                reader.Get(info.offset);
+                reader.Get(info.length);
+                reader.Get(shapeCount);
+                for (uint32_t sh = 0; sh < shapeCount && reader.Ok(); ++sh) {
+                    std::pair<std::string, std::string> shape;
+                    reader.GetString(shape.first);
+                    reader.GetString(shape.second);
+                    info.shapes.push_back(std::move(shape));
+                }
+                file.sets.push_back(std::move(info));
+            }
+            files[fileName] = std::move(file);
+        }
+
+        if (!reader.Ok() || !reader.AtEnd()) return;
+        files_ = std::move(files);
+    }
+
+    bool Save() const {
+        BinaryWriter writer;
+        writer.Put(kMagic);
+        writer.Put(kVersion);
+        writer.PutString(root_.generic_u8string());
+        writer.Put(static_cast<uint32_t>(files_.size()));
+        for (const auto& file : files_) {
+            writer.PutString(file.first);
+            writer.Put(file.second.mtime);
+            writer.Put(file.second.size);
+            writer.Put(static_cast<uint32_t>(file.second.sets.size()));
+            for (const auto& info : file.second.sets) {
+                writer.PutString(info.name);
+                writer.PutString(info.dataFolder);
+                writer.PutString(info.sourceFile);
+                writer.Put(info.offset);
+                writer.Put(info.length);
+                writer.Put(static_cast<uint32_t>(info.shapes.size()));
+                for (const auto& shape : info.shapes) {
+                    writer.PutString(shape.first);
+                    writer.PutString(shape.second);
+                }
+            }
+        }
+        return writer.Save(cacheFile_);
+    }
+
+    fs::path root_;
+    fs::path cacheFile_;
+    std::map<std::string, SliderSetCatalogFile> files_; // .osp file name -> sets
+    std::unordered_map<std::string, std::pair<std::string, const SliderSetInfo*>> byName_;
+};
+
+bool OSDFile::Read(const fs::path& fileName, const OsdDataNames* only) {
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file) {
+        if (gVerbose) {
+            std::cerr << "Failed to open OSD: " << fileName.string() << "\n";
+        }
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    char header[4] = {};
+    file.read(header, sizeof(header));
+    const size_t headerBytes = static_cast<size_t>(file.gcount());
+    bool headerOk = headerBytes == 4 &&
+                    ((header[0] == 'O' && header[1] == 'S' && header[2] == 'D' && header[3] == '\0') ||
+                     (header[0] == '\0' && header[1] == 'D' && header[2] == 'S' && header[3] == 'O'));
+    if (!headerOk) {
+        if (gVerbose) {
+            std::cerr << "Invalid OSD header in " << fileName.string()
+                      << " bytes: "
+                      << std::hex;
+            for (size_t i = 0; i < 4; ++i) {
+                int b = i < headerBytes ? static_cast<int>(static_cast<unsigned char>(header[i])) : 0;
+                std::cerr << b << (i < 3 ? " " : "");
+            }
+            std::cerr << std::dec << "\n";
+        }
+        return false;
+    }
+
+    struct Block {
+        std::string name;
+        size_t dataOffset = 0; // into `raw`
+        uint16_t diffSize = 0;
+    };
+
+    // On-disk entry: uint16 index followed by three floats, packed.
+    constexpr size_t kEntrySize = sizeof(uint16_t) + 3 * sizeof(float);
+
+    uint64_t pos = 8; // header + version
+    uint32_t dataCount = 0;
+    file.seekg(static_cast<std::streamoff>(pos));
+    file.read(reinterpret_cast<char*>(&dataCount), sizeof(dataCount));
+    if (!file) return false;
+    pos += sizeof(dataCount);
+
+    std::vector<Block> blocks;
+    std::string raw;
+    size_t arenaBytes = 0;
+    uint64_t skippedBytes = 0;
+    for (uint32_t i = 0; i < dataCount; ++i) {
+        if (pos + 1 > fileSize) break;
+        uint8_t nameLength = 0;
+        file.read(reinterpret_cast<char*>(&nameLength), 1);
+        pos += 1;
+        if (pos + nameLength + 2 > fileSize) break;
+        Block block;
+        block.name.resize(nameLength);
+        file.read(&block.name[0], nameLength);
+        file.read(reinterpret_cast<char*>(&block.diffSize), sizeof(block.diffSize));
+        pos += nameLength + 2;
+        uint64_t available = (fileSize - pos) / kEntrySize;
+        if (block.diffSize > available) block.diffSize = static_cast<uint16_t>(available);
+        const size_t blockBytes = static_cast<size_t>(block.diffSize) * kEntrySize;
+        pos += blockBytes;
+
+        if (only && only->find(block.name) == only->end()) {
+            file.seekg(static_cast<std::streamoff>(blockBytes), std::ios::cur);
+            skippedBytes += blockBytes;
+            continue;
+        }
+        block.dataOffset = raw.size();
+        raw.resize(raw.size() + blockBytes);
+        file.read(&raw[block.dataOffset], static_cast<std::streamsize>(blockBytes));
+        if (!file) break;
+        arenaBytes += DiffArena::SetBytes(block.diffSize);
+        blocks.push_back(std::move(block));
+    }
+
+    ProfileBytesRead(std::min(pos, fileSize) - skippedBytes);
+
+    auto arena = std::make_shared<DiffArena>(arenaBytes);
+    storageBytes = arena->Capacity();
+
+    std::vector<std::pair<uint16_t, uint32_t>> order; // (vertex index, entry)
+    for (const auto& block : blocks) {
+        const char* data = raw.data() + block.dataOffset;
+        order.clear();
+        order.reserve(block.diffSize);
+        for (uint32_t e = 0; e < block.diffSize; ++e) {
+            uint16_t index = 0;
+            std::memcpy(&index, data + e * kEntrySize, sizeof(uint16_t));
+            order.emplace_back(index, e);
+        }
+        // Stable so that, as with the former map insert, the last duplicate wins.
+        std::stable_sort(order.begin(), order.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        uint16_t* indices = arena->Take<uint16_t>(block.diffSize);
+        float* dx = arena->Take<float>(block.diffSize);
+        float* dy = arena->Take<float>(block.diffSize);
+        float* dz = arena->Take<float>(block.diffSize);
+
+        uint32_t count = 0;
+        for (size_t k = 0; k < order.size(); ++k) {
+            if (k + 1 < order.size() && order[k + 1].first == order[k].first) continue;
+            nifly::Vector3 v;
+            std::memcpy(&v.x, data + order[k].second * kEntrySize + sizeof(uint16_t), 3 * sizeof(float));
+            v.clampEpsilon();
+            indices[count] = order[k].first;
+            dx[count] = v.x;
+            dy[count] = v.y;
+            dz[count] = v.z;
+            count++;
+        }
+
+        TargetDataDiffs diffs;
+        diffs.count = count;
+        diffs.indices = indices;
+        diffs.dx = dx;
+        diffs.dy = dy;
+        diffs.dz = dz;
+        diffs.owner = arena;
+        dataDiffs[block.name] = std::move(diffs);
+    }
+
+    if (gVerbose) {
+        std::cerr << "Loaded OSD: " << fileName.string() << " entries: " << dataCount
+                  << ", decoded: " << blocks.size() << "\n";
+    }
+
+    return true;
+}
+
+bool DiffDataSets::LoadData(const std::unordered_map<std::string, OsdDataNames>& osdNames) {
+    ProfileScope profile(ProfileStage::OsdRead);
+    for (const auto& osd : osdNames) {
+        if (osd.second.empty()) continue;
+        OSDFile osdFile;
+        if (!osdFile.Read(osd.first, &osd.second)) {
+            continue;
+        }
+        for (const auto& dataNames : osd.second) {
+            auto it = osdFile.dataDiffs.find(dataNames.first);
+            if (it == osdFile.dataDiffs.end()) continue;
+            MoveToSet(dataNames.first, dataNames.second, std::move(it->second));
+        }
+    }
+    return true;
+}
+
+static fs::path FindFileRecursive(const fs::path& root, const std::string& fileName) {
+    for (auto& entry : fs::recursive_directory_iterator(root)) {
+        if (!entry.is_regular_file()) continue;
+        if (entry.path().filename().string() == fileName) return entry.path();
+    }
+    return {};
+}
+
+static std::string ToLowerAscii(std::string text) {
+    for (char& c : text) {
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+    }
+    return text;
+}
+
+// File name -> locations index over ShapeData, built from one walk and kept in
+// the cache directory. Replaces a full recursive walk per unresolved OSD
+// reference with a hash lookup.
+class ShapeDataIndex {
+public:
+    void Open(const fs::path& shapeDataRoot, const fs::path& cacheFile) {
+        root_ = shapeDataRoot;
+        cacheFile_ = cacheFile;
+        if (!cacheFile_.empty()) Load();
+        Revalidate();
+    }
+
+    void Revalidate() {
+        bool changed = tree_.Refresh(root_, [](const fs::path&) { return true; });
+        if (changed || byName_.empty()) {
+            byName_.clear();
+            for (const auto& rel : tree_.files) {
+                size_t slash = rel.find_last_of('/');
+                std::string fileName = slash == std::string::npos ? rel : rel.substr(slash + 1);
+                byName_.emplace(ToLowerAscii(fileName), &rel);
+            }
+        }
+        if (changed && !cacheFile_.empty() && !Save() && gVerbose) {
+            std::cerr << "Failed to write ShapeData index: " << cacheFile_.string() << "\n";
+        }
+        if (gVerbose) {
+            std::cerr << "ShapeData index: " << tree_.files.size() << " files in " << tree_.dirs.size()
+                      << " directories" << (changed ? ", updated" : "") << "\n";
+        }
+    }
+
+    // Finds a file by name anywhere under ShapeData. When several files share the
+    // name the winner is deterministic: exact-case name first, then a file inside
+    // the slider set's data folder, then the shallowest path, then the
+    // lexicographically smallest path.
+    fs::path Find(const std::string& fileName, const std::string& dataFolder) const {
+        auto range = byName_.equal_range(ToLowerAscii(fileName));
+        const std::string* best = nullptr;
+        std::tuple<int, int, size_t> bestRank{};
+        std::string folderPrefix = fs::u8path(dataFolder).generic_u8string();
+        if (!folderPrefix.empty() && folderPrefix.back() != '/') folderPrefix += '/';
+
+        for (auto it = range.first; it != range.second; ++it) {
+            const std::string& rel = *it->second;
+            size_t slash = rel.find_last_of('/');
+            bool exactCase = rel.compare(slash == std::string::npos ? 0 : slash + 1, std::string::npos, fileName) == 0;
+            bool inFolder = !folderPrefix.empty() && rel.compare(0, folderPrefix.size(), folderPrefix) == 0;
+            size_t depth = static_cast<size_t>(std::count(rel.begin(), rel.end(), '/'));
+            std::tuple<int, int, size_t> rank{exactCase ? 0 : 1, inFolder ? 0 : 1, depth};
+            if (!best || rank < bestRank || (rank == bestRank && rel < *best)) {
+                best = &rel;
+                bestRank = rank;
+            }
+        }
+
+        return best ? root_ / fs::u8path(*best) : fs::path();
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x44535342; // 'BSSD'
+    static constexpr uint32_t kVersion = 1;
+
+    void Load() {
+        std::string data;
+        if (!ReadFileBytes(cacheFile_, data)) return;
+
+        BinaryReader reader(data);
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        std::string root;
+        reader.Get(magic);
+        reader.Get(version);
+        reader.GetString(root);
+        if (!reader.Ok() || magic != kMagic || version != kVersion || root != root_.generic_u8string()) return;
+
+        DirectoryTree tree;
+        if (!tree.Read(reader) || !reader.AtEnd()) return;
+        tree_ = std::move(tree);
+    }
+
+    bool Save() const {
+        BinaryWriter writer;
+        writer.Put(kMagic);
+        writer.Put(kVersion);
+        writer.PutString(root_.generic_u8string());
+        tree_.Write(writer);
+        return writer.Save(cacheFile_);
+    }
+
+    fs::path root_;
+    fs::path cacheFile_;
+    DirectoryTree tree_;
+    std::unordered_multimap<std::string, const std::string*> byName_; // lower-case file name -> relative path
+};
+
+static bool LoadMeshShapes(const fs::path& nifPath, const SliderSet& sliderSet, std::vector<MeshShape>& outShapes) {
+    ProfileScope profile(ProfileStage::NifLoad);
+    nifly::NifFile nif(nifPath);
+    if (!nif.IsValid()) return false;
+    std::error_code ec;
+    const auto nifSize = fs::file_size(nifPath, ec);
+    if (!ec) ProfileBytesRead(nifSize);
+
+    for (const auto& shapePair : sliderSet.shapes) {
+        const std::string& shapeName = shapePair.first;
+        const std::string& targetName = shapePair.second;
+
+        auto* shape = nif.FindBlockByName<nifly::NiShape>(shapeName);
+        if (!shape) {
+            std::cerr << "Shape not found in NIF: " << shapeName << "\n";
+            return false;
+        }
+
+        std::vector<nifly::Vector3> verts;
+        if (!nif.GetVertsForShape(shape, verts)) {
+            std::cerr << "Failed to read verts for shape: " << shapeName << "\n";
+            return false;
+        }
+
+        std::vector<nifly::Triangle> tris;
+        if (!shape->GetTriangles(tris)) {
+            std::cerr << "Failed to read triangles for shape: " << shapeName << "\n";
+            return false;
+        }
+
+        MeshShape ms;
+        ms.name = shapeName;
+        ms.targetName = targetName;
+        ms.verts = std::move(verts);
+        ms.tris = std::move(tris);
+        outShapes.push_back(std::move(ms));
+    }
+
+    return true;
+}
+
+// Resolves the OSD file of every slider data reference. Nothing is decoded
+// here; see DiffDataSets::LoadData and LoadDiffSets.
+// outProbed, when given, receives the paths whose appearance or change could
+// resolve a name differently: expected OSD paths that were missing and, once a
+// name had to be searched for, every directory under shapeDataRoot.
+OsdRefs ResolveOsdRefs(const SliderSet& sliderSet,
+                       const fs::path& shapeDataRoot,
+                       bool verbose,
+                       const ShapeDataIndex* shapeIndex,
+                       std::vector<fs::path>* outProbed) {
+    ProfileScope profile(ProfileStage::OsdResolve);
+    OsdRefs osdNames;
+    std::unordered_map<std::string, fs::path> resolved; // OSD file name -> path ("" if missing)
+    size_t missingFiles = 0;
+    size_t totalRefs = 0;
+    bool searched = false;
+
+    for (const auto& slider : sliderSet.sliders) {
+        for (const auto& ddf : slider.dataFiles) {
+            if (ddf.fileName.size() <= 4) continue;
+
+            const bool isBSD = ddf.fileName.size() >= 4 && ddf.fileName.substr(ddf.fileName.size() - 4) == ".bsd";
+            if (isBSD) continue;
+
+            size_t split = ddf.fileName.find_last_of('/');
+            if (split == std::string::npos) split = ddf.fileName.find_last_of('\\');
+            if (split == std::string::npos) continue;
+
+            std::string fileName = ddf.fileName.substr(0, split);
+            std::string dataName = ddf.fileName.substr(split + 1);
+
+            auto known = resolved.find(fileName);
+            if (known == resolved.end()) {
+                fs::path path = shapeDataRoot / sliderSet.dataFolder / fileName;
+                if (!fs::exists(path)) {
+                    if (outProbed) outProbed->push_back(path);
+                    searched = true;
+                    path = shapeIndex ? shapeIndex->Find(fileName, sliderSet.dataFolder)
+                                      : FindFileRecursive(shapeDataRoot, fileName);
+                }
+                known = resolved.emplace(fileName, std::move(path)).first;
+            }
+            const fs::path& osdPath = known->second;
+
+            if (!osdPath.empty()) {
+                osdNames[osdPath.string()][dataName] = ddf.targetName;
+                totalRefs++;
+                if (verbose && totalRefs <= 3) {
+                    std::cerr << "OSD ref: " << osdPath.string() << " data " << dataName << "\n";
+                }
+            } else {
+                missingFiles++;
+                if (verbose) {
+                    std::cerr << "Missing OSD: " << fileName << " (data " << dataName << ")\n";
+                }
+            }
+        }
+    }
+
+    if (outProbed && searched) {
+        std::error_code ec;
+        outProbed->push_back(shapeDataRoot);
+        for (fs::recursive_directory_iterator it(shapeDataRoot, ec), end; !ec && it != end; it.increment(ec)) {
+            std::error_code typeEc;
+            if (it->is_directory(typeEc)) outProbed->push_back(it->path());
+        }
+    }
+
+    if (verbose) {
+        std::cout << "OSD refs: " << totalRefs << ", missing files: " << missingFiles << "\n";
+    }
+    return osdNames;
+}
+
+// Interns the data and target names of a slider set and its shapes into the
+// tables of the diff sets they morph with. Run once when a body is loaded.
+void InternMorphSymbols(SliderSet& sliderSet, std::vector<MeshShape>& shapes, DiffDataSets& diffData) {
+    for (auto& slider : sliderSet.sliders) {
+        for (auto& ddf : slider.dataFiles) {
+            ddf.dataId = diffData.setNames.Intern(ddf.dataName);
+            ddf.targetId = diffData.targetNames.Intern(ddf.targetName);
+        }
+    }
+    for (auto& shape : shapes) shape.targetId = diffData.targetNames.Intern(shape.targetName);
+}
+
+static float GetPresetValue(const Preset& preset, const Slider& slider) {
+    auto itBig = preset.big.find(slider.name);
+    if (itBig != preset.big.end()) return itBig->second;
+    auto itSmall = preset.small.find(slider.name);
+    if (itSmall != preset.small.end()) return itSmall->second;
+    return slider.defaultValue;
+}
+
+SliderValues ResolvePresetValues(const Preset& preset, const SliderSet& sliderSet) {
+    SliderValues values;
+    values.reserve(sliderSet.sliders.size());
+    for (const auto& slider : sliderSet.sliders) values.push_back(GetPresetValue(preset, slider));
+    return values;
+}
+
+// Effective weight of a slider value, as the morph applies it: inverted sliders use 1 - value and positive zap values are skipped.
+static float SliderWeight(const Slider& slider, float value) {
+    if (slider.invert) value = 1.0f - value;
+    if (slider.zap && value > 0.0f) return 0.0f;
+    return value;
+}
+
+static float SliderTargetWeight(const Preset& preset, const Slider& slider) {
+    return SliderWeight(slider, GetPresetValue(preset, slider));
+}
+
+// IDs of the diff sets the morph stage will touch: vertex data of sliders whose
+// effective (inverted) value is non-zero, and clamp data of positive clamp
+// sliders. Positive zap sliders are skipped by the morph.
+static std::vector<uint32_t> CollectPresetDiffSets(const SliderValues& values, const SliderSet& sliderSet) {
+    std::vector<uint32_t> ids;
+    for (size_t k = 0; k < sliderSet.sliders.size(); ++k) {
+        const Slider& slider = sliderSet.sliders[k];
+        float val = values[k];
+        if (slider.invert) val = 1.0f - val;
+        if (val == 0.0f || (slider.zap && val > 0.0f)) continue;
+        if (slider.uv && !(slider.clamp && val > 0.0f)) continue;
+        for (const auto& ddf : slider.dataFiles) ids.push_back(ddf.dataId);
+    }
+    return ids;
+}
+
+// Morph engine. A shape's morph is flattened into a plan of (diff set, weight)
+// steps in slider order, resolved once, then run by a kernel per step. Each add
+// step is v += diff * weight per entry, exactly as the scalar path does it, so
+// every kernel produces bit-identical results; the SIMD kernels batch the
+// multiplies and use vector load/add/store where indices are contiguous.
+
+const char* SimdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Sse2: return "sse2";
+    case SimdLevel::Avx2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+static SimdLevel DetectSimdLevel() {
+#ifdef BSRENDER_X86_SIMD
+#ifdef _MSC_VER
+    int info[4] = {};
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        __cpuidex(info, 7, 0);
+        const bool avx2 = (info[1] & (1 << 5)) != 0;
+        if (osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6) return SimdLevel::Avx2;
+    }
+#else
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::Avx2;
+#endif
+    return SimdLevel::Sse2;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// Flattens the morph of every shape into one plan per shape. Mirrors the
+// slider loop: per slider, its vertex data (non-UV sliders with a non-zero
+// value) and then, for positive clamp sliders, its clamp data. Positive zap
+// sliders are skipped.
+std::vector<std::vector<MorphStep>> BuildMorphPlans(const SliderValues& values, const SliderSet& sliderSet,
+                                                    const DiffDataSets& diffData,
+                                                    const std::vector<MeshShape>& shapes, bool verbose) {
+    std::vector<std::vector<MorphStep>> plans(shapes.size());
+    auto addStep = [&](size_t s, const SliderDataFile& ddf, float weight, bool clamp) {
+        const TargetDataDiffs* diffs = diffData.Find(ddf.dataId, ddf.targetId);
+        if (!diffs) return;
+        MorphStep step;
+        step.diffs = diffs;
+        step.count = diffs->CountBelow(shapes[s].verts.size());
+        step.weight = weight;
+        step.clamp = clamp;
+        if (step.count) plans[s].push_back(step);
+    };
+
+    for (size_t k = 0; k < sliderSet.sliders.size(); ++k) {
+        const Slider& slider = sliderSet.sliders[k];
+        float val = values[k];
+        if (slider.invert) val = 1.0f - val;
+        if (slider.zap && val > 0.0f) continue;
+        const bool clamp = slider.clamp && val > 0.0f;
+        if (!clamp && (val == 0.0f || slider.uv) && !verbose) continue;
+
+        for (size_t s = 0; s < shapes.size(); ++s) {
+            for (const auto& ddf : slider.dataFiles) {
+                if (ddf.targetId != shapes[s].targetId || slider.uv) continue;
+                if (verbose && val != 0.0f && !diffData.HasSet(ddf.dataId)) {
+                    std::cerr << "Missing diff set: " << ddf.dataName << " (target " << ddf.targetName << ")\n";
+                }
+                if (val != 0.0f) addStep(s, ddf, val, false);
+            }
+            if (clamp) {
+                for (const auto& ddf : slider.dataFiles) {
+                    if (ddf.targetId == shapes[s].targetId) addStep(s, ddf, 0.0f, true);
+                }
+            }
+        }
+    }
+    return plans;
+}
+
+// Kernels work in place on the AoS vertex array (x, y, z adjacent). Converting
+// to SoA and back costs more than the morph: diff entries are sparse, and a
+// vertex's three components share a cache line in AoS.
+static_assert(sizeof(nifly::Vector3) == 3 * sizeof(float), "Vector3 must be three packed floats");
+
+static void MorphAddScalar(const TargetDataDiffs& d, uint32_t begin, uint32_t end, float w, float* xyz) {
+    for (uint32_t i = begin; i < end; ++i) {
+        float* v = xyz + 3 * static_cast<size_t>(d.indices[i]);
+        v[0] += d.dx[i] * w;
+        v[1] += d.dy[i] * w;
+        v[2] += d.dz[i] * w;
+    }
+}
+
+#ifdef BSRENDER_X86_SIMD
+// Adds four weighted diffs to four consecutive vertices starting at v.
+static inline void AddRun4(float* v, __m128 mx, __m128 my, __m128 mz) {
+    const __m128 xyLo = _mm_unpacklo_ps(mx, my);                              // x0 y0 x1 y1
+    const __m128 xyHi = _mm_unpackhi_ps(mx, my);                              // x2 y2 x3 y3
+    const __m128 zx01 = _mm_shuffle_ps(mz, mx, _MM_SHUFFLE(1, 1, 0, 0));      // z0 z0 x1 x1
+    const __m128 yz1 = _mm_shuffle_ps(my, mz, _MM_SHUFFLE(1, 1, 1, 1));       // y1 y1 z1 z1
+    const __m128 zx23 = _mm_shuffle_ps(mz, mx, _MM_SHUFFLE(3, 3, 2, 2));      // z2 z2 x3 x3
+    const __m128 yz3 = _mm_shuffle_ps(my, mz, _MM_SHUFFLE(3, 3, 3, 3));       // y3 y3 z3 z3
+    const __m128 a = _mm_shuffle_ps(xyLo, zx01, _MM_SHUFFLE(2, 0, 1, 0));     // x0 y0 z0 x1
+    const __m128 b = _mm_shuffle_ps(yz1, xyHi, _MM_SHUFFLE(1, 0, 2, 0));      // y1 z1 x2 y2
+    const __m128 c = _mm_shuffle_ps(zx23, yz3, _MM_SHUFFLE(2, 0, 2, 0));      // z2 x3 y3 z3
+    _mm_storeu_ps(v + 0, _mm_add_ps(_mm_loadu_ps(v + 0), a));
+    _mm_storeu_ps(v + 4, _mm_add_ps(_mm_loadu_ps(v + 4), b));
+    _mm_storeu_ps(v + 8, _mm_add_ps(_mm_loadu_ps(v + 8), c));
+}
+
+static void MorphAddSse2(const TargetDataDiffs& d, uint32_t begin, uint32_t end, float w, float* xyz) {
+    const __m128 weight = _mm_set1_ps(w);
+    alignas(16) float px[4];
+    alignas(16) float py[4];
+    alignas(16) float pz[4];
+    uint32_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 mx = _mm_mul_ps(_mm_loadu_ps(d.dx + i), weight);
+        const __m128 my = _mm_mul_ps(_mm_loadu_ps(d.dy + i), weight);
+        const __m128 mz = _mm_mul_ps(_mm_loadu_ps(d.dz + i), weight);
+        const uint16_t first = d.indices[i];
+        // Indices are strictly increasing, so a span of 3 means four neighbours.
+        if (d.indices[i + 3] - first == 3) {
+            AddRun4(xyz + 3 * static_cast<size_t>(first), mx, my, mz);
+            continue;
+        }
+        _mm_store_ps(px, mx);
+        _mm_store_ps(py, my);
+        _mm_store_ps(pz, mz);
+        for (uint32_t k = 0; k < 4; ++k) {
+            float* v = xyz + 3 * static_cast<size_t>(d.indices[i + k]);
+            v[0] += px[k];
+            v[1] += py[k];
+            v[2] += pz[k];
+        }
+    }
+    MorphAddScalar(d, i, end, w, xyz);
+}
+
+BSRENDER_TARGET_AVX2
+static void MorphAddAvx2(const TargetDataDiffs& d, uint32_t begin, uint32_t end, float w, float* xyz) {
+    const __m256 weight = _mm256_set1_ps(w);
+    alignas(32) float px[8];
+    alignas(32) float py[8];
+    alignas(32) float pz[8];
+    uint32_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 mx = _mm256_mul_ps(_mm256_loadu_ps(d.dx + i), weight);
+        const __m256 my = _mm256_mul_ps(_mm256_loadu_ps(d.dy + i), weight);
+        const __m256 mz = _mm256_mul_ps(_mm256_loadu_ps(d.dz + i), weight);
+        const uint16_t first = d.indices[i];
+        if (d.indices[i + 7] - first == 7) {
+            float* v = xyz + 3 * static_cast<size_t>(first);
+            AddRun4(v, _mm256_castps256_ps128(mx), _mm256_castps256_ps128(my), _mm256_castps256_ps128(mz));
+            AddRun4(v + 12, _mm256_extractf128_ps(mx, 1), _mm256_extractf128_ps(my, 1), _mm256_extractf128_ps(mz, 1));
+            continue;
+        }
+        _mm256_store_ps(px, mx);
+        _mm256_store_ps(py, my);
+        _mm256_store_ps(pz, mz);
+        for (uint32_t k = 0; k < 8; ++k) {
+            float* v = xyz + 3 * static_cast<size_t>(d.indices[i + k]);
+            v[0] += px[k];
+            v[1] += py[k];
+            v[2] += pz[k];
+        }
+    }
+    MorphAddScalar(d, i, end, w, xyz);
+}
+#endif
+
+// Runs a plan over the vertices [vertBegin, vertEnd) of a shape. Each step only
+// touches its entries in that range, so disjoint ranges can run concurrently
+// and every vertex still sees its steps in plan order.
+static void RunMorphPlan(const std::vector<MorphStep>& plan, std::vector<nifly::Vector3>& verts, uint32_t vertBegin,
+                         uint32_t vertEnd, SimdLevel level) {
+    float* xyz = &verts.data()->x;
+    const bool whole = vertBegin == 0 && vertEnd >= verts.size();
+    for (const auto& step : plan) {
+        const TargetDataDiffs& d = *step.diffs;
+        uint32_t begin = 0;
+        uint32_t end = step.count;
+        if (!whole) {
+            auto below = [](uint16_t index, uint32_t vertex) { return index < vertex; };
+            begin = static_cast<uint32_t>(std::lower_bound(d.indices, d.indices + end, vertBegin, below) - d.indices);
+            end = static_cast<uint32_t>(std::lower_bound(d.indices + begin, d.indices + end, vertEnd, below) - d.indices);
+        }
+
+        if (step.clamp) {
+            for (uint32_t i = begin; i < end; ++i) {
+                float* v = xyz + 3 * static_cast<size_t>(d.indices[i]);
+                v[0] = d.dx[i];
+                v[1] = d.dy[i];
+                v[2] = d.dz[i];
+            }
+            continue;
+        }
+        switch (level) {
+#ifdef BSRENDER_X86_SIMD
+        case SimdLevel::Avx2: MorphAddAvx2(d, begin, end, step.weight, xyz); break;
+        case SimdLevel::Sse2: MorphAddSse2(d, begin, end, step.weight, xyz); break;
+#endif
+        default: MorphAddScalar(d, begin, end, step.weight, xyz); break;
+        }
+    }
+}
+
+const SimdLevel gSimdLevel = DetectSimdLevel();
+
+// Reference path: one DiffDataSets lookup and AoS update per slider x data file
+// x shape. Only `bsrender bench` uses it, to measure and cross-check the engine.
+void MorphShapesReference(const Preset& preset, const SliderSet& sliderSet, const DiffDataSets& diffData,
+                          std::vector<MeshShape>& shapes) {
+    for (const auto& slider : sliderSet.sliders) {
+        float val = GetPresetValue(preset, slider);
+        if (slider.invert) val = 1.0f - val;
+
+        for (auto& shape : shapes) {
+            if (slider.zap && val > 0.0f) continue;
+
+            for (const auto& ddf : slider.dataFiles) {
+                if (ddf.targetName != shape.targetName) continue;
+                if (!slider.uv) diffData.ApplyDiff(ddf.dataName, ddf.targetName, val, shape.verts);
+            }
+
+            if (slider.clamp && val > 0.0f) {
+                for (const auto& ddf : slider.dataFiles) {
+                    if (ddf.targetName != shape.targetName) continue;
+                    diffData.ApplyClamp(ddf.dataName, ddf.targetName, shape.verts);
+                }
+            }
+        }
+    }
+}
+
+// Vertices per morph task; large shapes are split so all workers get a share.
+constexpr uint32_t kMorphChunkVerts = 4096;
+
+// Runs per-shape plans over the shapes in place, one task per vertex chunk.
+static void RunMorphPlans(const std::vector<std::vector<MorphStep>>& plans, std::vector<MeshShape>& shapes,
+                          SimdLevel level = gSimdLevel) {
+    struct Task {
+        size_t shape;
+        uint32_t begin;
+        uint32_t end;
+    };
+    std::vector<Task> tasks;
+    const bool split = WorkerPool().Size() > 1;
+    for (size_t s = 0; s < shapes.size(); ++s) {
+        const uint32_t count = static_cast<uint32_t>(shapes[s].verts.size());
+        if (plans[s].empty() || count == 0) continue;
+        const uint32_t chunk = split ? kMorphChunkVerts : count;
+        for (uint32_t begin = 0; begin < count; begin += chunk) {
+            tasks.push_back({s, begin, std::min(count, begin + chunk)});
+        }
+    }
+
+    WorkerPool().ParallelFor(tasks.size(), [&](size_t t) {
+        const Task& task = tasks[t];
+        RunMorphPlan(plans[task.shape], shapes[task.shape].verts, task.begin, task.end, level);
+    });
+}
+
+// Applies the preset's slider values to every shape in place.
+void MorphShapes(const SliderValues& values, const SliderSet& sliderSet, const DiffDataSets& diffData,
+                 bool verbose, std::vector<MeshShape>& shapes, SimdLevel level) {
+    const auto plans = BuildMorphPlans(values, sliderSet, diffData, shapes, verbose);
+    if (gProfile.enabled) {
+        for (const auto& plan : plans) {
+            for (const auto& step : plan) gProfile.diffEntries += step.count;
+        }
+    }
+    RunMorphPlans(plans, shapes, level);
+}
+
+static Vec3 RotateZ(const Vec3& v, float radians) {
+    float c = std::cos(radians);
+    float s = std::sin(radians);
+    return {v.x * c - v.y * s, v.x * s + v.y * c, v.z};
+}
+
+static Vec3 RotateX(const Vec3& v, float radians) {
+    float c = std::cos(radians);
+    float s = std::sin(radians);
+    return {v.x, v.y * c - v.z * s, v.y * s + v.z * c};
+}
+
+static Vec3 RotateY(const Vec3& v, float radians) {
+    float c = std::cos(radians);
+    float s = std::sin(radians);
+    return {v.x * c + v.z * s, v.y, -v.x * s + v.z * c};
+}
+
+static Vec3 RotateYawPitchRoll(const Vec3& v, float yaw, float pitch, float roll) {
+    Vec3 r = RotateZ(v, yaw);
+    r = RotateX(r, pitch);
+    r = RotateY(r, roll);
+    return r;
+}
+
+static Vec3 ConvertToYUp(const Vec3& v) {
+    // Convert from Z-up (NIF) to Y-up (glTF/Three.js)
+    return {v.x, v.z, -v.y};
+}
+
+static Vec3 Sub(const Vec3& a, const Vec3& b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+static Vec3 Cross(const Vec3& a, const Vec3& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+static float Dot(const Vec3& a, const Vec3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vec3 Normalize(const Vec3& v) {
+    float len = std::sqrt(Dot(v, v));
+    if (len <= 0.000001f) return {0.0f, 0.0f, 0.0f};
+    return {v.x / len, v.y / len, v.z / len};
+}
+
+// Vertices per normal accumulation task.
+constexpr size_t kNormalChunkVerts = 16384;
+
+// Counting sort of the triangle corners by vertex.
+VertexAdjacency BuildVertexAdjacency(size_t vertCount, const std::vector<std::array<uint32_t, 3>>& tris) {
+    VertexAdjacency adjacency;
+    adjacency.offsets.assign(vertCount + 1, 0);
+    for (const auto& tri : tris) {
+        for (uint32_t corner : tri) adjacency.offsets[corner + 1]++;
+    }
+    for (size_t v = 0; v < vertCount; ++v) adjacency.offsets[v + 1] += adjacency.offsets[v];
+
+    adjacency.triangles.resize(tris.size() * 3);
+    std::vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t t = 0; t < tris.size(); ++t) {
+        for (uint32_t corner : tris[t]) adjacency.triangles[cursor[corner]++] = static_cast<uint32_t>(t);
+    }
+    return adjacency;
+}
+
+// Area-independent vertex normals: the sum of the unit normals of adjacent
+// faces, normalized. Face normals are computed in parallel, then every vertex
+// gathers its faces from the adjacency in triangle order, so the sums match a
+// single scatter pass over the triangles bit for bit. Without a fitting
+// adjacency one is built for this call.
+std::vector<Vec3> ComputeVertexNormals(const std::vector<Vec3>& verts,
+                                       const std::vector<std::array<uint32_t, 3>>& tris,
+                                       const VertexAdjacency* adjacency) {
+    ThreadPool& pool = WorkerPool();
+
+    VertexAdjacency built;
+    if (!adjacency || !adjacency->Fits(verts.size(), tris.size())) {
+        built = BuildVertexAdjacency(verts.size(), tris);
+        adjacency = &built;
+    }
+
+    std::vector<Vec3> faceNormals(tris.size());
+    const size_t triChunks = (tris.size() + kNormalChunkVerts - 1) / kNormalChunkVerts;
+    pool.ParallelFor(triChunks, [&](size_t c) {
+        const size_t end = std::min(tris.size(), (c + 1) * kNormalChunkVerts);
+        for (size_t t = c * kNormalChunkVerts; t < end; ++t) {
+            const auto& tri = tris[t];
+            const Vec3& v0 = verts[tri[0]];
+            const Vec3& v1 = verts[tri[1]];
+            const Vec3& v2 = verts[tri[2]];
+            faceNormals[t] = Normalize(Cross(Sub(v1, v0), Sub(v2, v0)));
+        }
+    });
+
+    std::vector<Vec3> normals(verts.size());
+    const uint32_t* offsets = adjacency->offsets.data();
+    const uint32_t* adjacent = adjacency->triangles.data();
+    const size_t vertChunks = (verts.size() + kNormalChunkVerts - 1) / kNormalChunkVerts;
+    pool.ParallelFor(vertChunks, [&](size_t c) {
+        const size_t end = std::min(verts.size(), (c + 1) * kNormalChunkVerts);
+        for (size_t i = c * kNormalChunkVerts; i < end; ++i) {
+            Vec3 sum = {0.0f, 0.0f, 0.0f};
+            for (uint32_t a = offsets[i]; a < offsets[i + 1]; ++a) {
+                const Vec3& n = faceNormals[adjacent[a]];
+                sum.x += n.x;
+                sum.y += n.y;
+                sum.z += n.z;
+            }
+            Vec3 n = Normalize(sum);
+            if (Dot(n, n) <= 0.000001f) {
+                n = {0.0f, 0.0f, 1.0f};
+            }
+            normals[i] = n;
+        }
+    });
+
+    return normals;
+}
+
+// Streams one GLB chunk's payload to the file through a small staging buffer,
+// so converted attributes never exist as a whole second copy.
+class GlbChunkStream {
+public:
+    explicit GlbChunkStream(std::ofstream& out) : out_(out) { staging_.reserve(kStagingBytes); }
+
+    void Write(const void* data, size_t size) {
+        Flush();
+        out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        written_ += size;
+    }
+
+    // Appends count elements of elemBytes each; fill(i, dst) encodes element i.
+    template <typename Fill>
+    void WriteElements(size_t count, size_t elemBytes, Fill&& fill) {
+        for (size_t i = 0; i < count; ++i) {
+            if (staging_.size() + elemBytes > kStagingBytes) Flush();
+            const size_t at = staging_.size();
+            staging_.resize(at + elemBytes);
+            fill(i, staging_.data() + at);
+        }
+    }
+
+    void Pad(uint8_t padByte) {
+        const size_t pending = written_ + staging_.size();
+        staging_.insert(staging_.end(), (4 - pending % 4) % 4, padByte);
+    }
+
+    void Flush() {
+        if (staging_.empty()) return;
+        out_.write(reinterpret_cast<const char*>(staging_.data()), static_cast<std::streamsize>(staging_.size()));
+        written_ += staging_.size();
+        staging_.clear();
+    }
+
+private:
+    static constexpr size_t kStagingBytes = 64 * 1024;
+    std::ofstream& out_;
+    std::vector<uint8_t> staging_;
+    size_t written_ = 0;
+};
+
+static size_t PadTo4(size_t size) {
+    return (size + 3) & ~size_t(3);
+}
+
+// Writes the mesh as a binary glTF. The JSON chunk is built first from the
+// known attribute sizes; then header, JSON and BIN are streamed straight to
+// the file.
+//
+// Compact mode uses KHR_mesh_quantization: positions become int16 offsets
+// from the bounds centre with a uniform node scale (uniform so normals stay
+// undistorted), normals become normalized int8, and indices are uint16 when
+// every vertex index fits. Vertex attributes are padded to 4-byte strides as
+// glTF requires, giving 12 bytes per vertex instead of 24.
+//
+// Morph targets, when given, follow the indices in the BIN chunk as sparse
+// uint32 index / float delta pairs; their names go to the mesh extras as
+// targetNames. In compact mode the deltas are divided by the node scale.
+bool ExportGlb(const std::string& path,
+               const std::vector<Vec3>& verts,
+               const std::vector<std::array<uint32_t, 3>>& tris,
+               const std::vector<Vec3>& normals,
+               bool compact,
+               const std::vector<GlbMorphTarget>& targets) {
+    static_assert(sizeof(Vec3) == 3 * sizeof(float), "Vec3 must be tightly packed");
+    static_assert(sizeof(tris[0]) == 3 * sizeof(uint32_t), "triangles must be tightly packed");
+    if (verts.empty() || tris.empty()) return false;
+    if (normals.size() != verts.size()) return false;
+
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float minZ = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest();
+    float maxY = std::numeric_limits<float>::lowest();
+    float maxZ = std::numeric_limits<float>::lowest();
+    for (const auto& v : verts) {
+        minX = std::min(minX, v.x);
+        minY = std::min(minY, v.y);
+        minZ = std::min(minZ, v.z);
+        maxX = std::max(maxX, v.x);
+        maxY = std::max(maxY, v.y);
+        maxZ = std::max(maxZ, v.z);
+    }
+
+    const bool shortIndices = compact && verts.size() <= 0xffff;
+    const size_t posStride = compact ? 4 * sizeof(int16_t) : 3 * sizeof(float);
+    const size_t normStride = compact ? 4 * sizeof(int8_t) : 3 * sizeof(float);
+    const size_t indexBytes = shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    const size_t posOffset = 0;
+    const size_t posBytes = verts.size() * posStride;
+    const size_t normOffset = posOffset + posBytes;
+    const size_t normBytes = normals.size() * normStride;
+    const size_t idxOffset = normOffset + normBytes;
+    const size_t idxBytes = tris.size() * 3 * indexBytes;
+    size_t binBytes = PadTo4(idxOffset + idxBytes);
+    std::vector<size_t> targetOffsets(targets.size());
+    for (size_t t = 0; t < targets.size(); ++t) {
+        if (targets[t].indices.size() != targets[t].deltas.size()) return false;
+        targetOffsets[t] = binBytes;
+        binBytes += targets[t].indices.size() * (sizeof(uint32_t) + sizeof(Vec3));
+    }
+
+    // Quantized positions: q = round((p - centre) / scale), |q| <= 32767.
+    const Vec3 centre = {(minX + maxX) * 0.5f, (minY + maxY) * 0.5f, (minZ + maxZ) * 0.5f};
+    const float halfExtent = std::max({maxX - minX, maxY - minY, maxZ - minZ, 1e-6f}) * 0.5f;
+    const float posScale = halfExtent / 32767.0f;
+    auto quantize = [&](float v, float c) {
+        return static_cast<int16_t>(std::clamp(std::lround((v - c) / posScale), -32767L, 32767L));
+    };
+
+    std::ostringstream json;
+    json.setf(std::ios::fixed);
+    json << std::setprecision(std::numeric_limits<float>::max_digits10);
+    json << "{";
+    json << "\"asset\":{\"version\":\"2.0\"},";
+    if (compact) {
+        json << "\"extensionsUsed\":[\"KHR_mesh_quantization\"],";
+        json << "\"extensionsRequired\":[\"KHR_mesh_quantization\"],";
+    }
+    json << "\"buffers\":[{\"byteLength\":" << binBytes << "}],";
+    json << "\"bufferViews\":[";
+    json << "{\"buffer\":0,\"byteOffset\":" << posOffset << ",\"byteLength\":" << posBytes;
+    if (compact) json << ",\"byteStride\":" << posStride;
+    json << ",\"target\":34962},";
+    json << "{\"buffer\":0,\"byteOffset\":" << normOffset << ",\"byteLength\":" << normBytes;
+    if (compact) json << ",\"byteStride\":" << normStride;
+    json << ",\"target\":34962},";
+    json << "{\"buffer\":0,\"byteOffset\":" << idxOffset << ",\"byteLength\":" << idxBytes << ",\"target\":34963}";
+    for (size_t t = 0; t < targets.size(); ++t) {
+        const size_t count = targets[t].indices.size();
+        if (count == 0) continue;
+        json << ",{\"buffer\":0,\"byteOffset\":" << targetOffsets[t] << ",\"byteLength\":" << count * sizeof(uint32_t) << "}";
+        json << ",{\"buffer\":0,\"byteOffset\":" << targetOffsets[t] + count * sizeof(uint32_t)
+             << ",\"byteLength\":" << count * sizeof(Vec3) << "}";
+    }
+    json << "],";
+    json << "\"accessors\":[";
+    if (compact) {
+        json << "{\"bufferView\":0,\"componentType\":5122,\"count\":" << verts.size() << ",\"type\":\"VEC3\",";
+        json << "\"min\":[" << quantize(minX, centre.x) << "," << quantize(minY, centre.y) << "," << quantize(minZ, centre.z) << "],";
+        json << "\"max\":[" << quantize(maxX, centre.x) << "," << quantize(maxY, centre.y) << "," << quantize(maxZ, centre.z) << "]},";
+        json << "{\"bufferView\":1,\"componentType\":5120,\"normalized\":true,\"count\":" << normals.size() << ",\"type\":\"VEC3\"},";
+    } else {
+        json << "{\"bufferView\":0,\"componentType\":5126,\"count\":" << verts.size() << ",\"type\":\"VEC3\",";
+        json << "\"min\":[" << minX << "," << minY << "," << minZ << "],";
+        json << "\"max\":[" << maxX << "," << maxY << "," << maxZ << "]},";
+        json << "{\"bufferView\":1,\"componentType\":5126,\"count\":" << normals.size() << ",\"type\":\"VEC3\"},";
+    }
+    json << "{\"bufferView\":2,\"componentType\":" << (shortIndices ? 5123 : 5125) << ",\"count\":" << (tris.size() * 3) << ",\"type\":\"SCALAR\"}";
+
+    // Sparse accessors must bound every element, including the implicit zeros.
+    const float deltaScale = compact ? 1.0f / posScale : 1.0f;
+    size_t sparseView = 3;
+    for (const auto& target : targets) {
+        const size_t count = target.indices.size();
+        Vec3 lo = {0.0f, 0.0f, 0.0f};
+        Vec3 hi = {0.0f, 0.0f, 0.0f};
+        if (count == verts.size() && count > 0) lo = hi = target.deltas[0];
+        for (const auto& d : target.deltas) {
+            lo = {std::min(lo.x, d.x), std::min(lo.y, d.y), std::min(lo.z, d.z)};
+            hi = {std::max(hi.x, d.x), std::max(hi.y, d.y), std::max(hi.z, d.z)};
+        }
+        json << ",{\"componentType\":5126,\"count\":" << verts.size() << ",\"type\":\"VEC3\",";
+        json << "\"min\":[" << lo.x * deltaScale << "," << lo.y * deltaScale << "," << lo.z * deltaScale << "],";
+        json << "\"max\":[" << hi.x * deltaScale << "," << hi.y * deltaScale << "," << hi.z * deltaScale << "]";
+        if (count > 0) {
+            json << ",\"sparse\":{\"count\":" << count << ",\"indices\":{\"bufferView\":" << sparseView
+                 << ",\"componentType\":5125},\"values\":{\"bufferView\":" << sparseView + 1 << "}}";
+            sparseView += 2;
+        }
+        json << "}";
+    }
+    json << "],";
+    json << "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2";
+    if (!targets.empty()) {
+        json << ",\"targets\":[";
+        for (size_t t = 0; t < targets.size(); ++t) {
+            json << (t ? "," : "") << "{\"POSITION\":" << 3 + t << "}";
+        }
+        json << "]";
+    }
+    json << "}]";
+    if (!targets.empty()) {
+        json << ",\"weights\":[";
+        for (size_t t = 0; t < targets.size(); ++t) json << (t ? ",0" : "0");
+        json << "],\"extras\":{\"targetNames\":[";
+        for (size_t t = 0; t < targets.size(); ++t) json << (t ? "," : "") << JsonQuote(targets[t].name);
+        json << "]}";
+    }
+    json << "}],";
+    if (compact) {
+        json << "\"nodes\":[{\"mesh\":0,\"translation\":[" << centre.x << "," << centre.y << "," << centre.z << "],";
+        json << "\"scale\":[" << posScale << "," << posScale << "," << posScale << "]}],";
+    } else {
+        json << "\"nodes\":[{\"mesh\":0}],";
+    }
+    json << "\"scenes\":[{\"nodes\":[0]}],";
+    json << "\"scene\":0";
+    json << "}";
+
+    const std::string jsonStr = json.str();
+    const uint32_t jsonChunkLen = static_cast<uint32_t>(PadTo4(jsonStr.size()));
+    const uint32_t binChunkLen = static_cast<uint32_t>(binBytes);
+    const uint32_t header[5] = {
+        0x46546C67, // 'glTF'
+        2,
+        12 + 8 + jsonChunkLen + 8 + binChunkLen,
+        jsonChunkLen,
+        0x4E4F534A, // 'JSON'
+    };
+    const uint32_t binHeader[2] = {binChunkLen, 0x004E4942}; // 'BIN\0'
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    GlbChunkStream stream(out);
+    stream.Write(header, sizeof(header));
+    stream.Write(jsonStr.data(), jsonStr.size());
+    stream.Pad(' ');
+    stream.Write(binHeader, sizeof(binHeader));
+
+    if (compact) {
+        stream.WriteElements(verts.size(), posStride, [&](size_t i, uint8_t* dst) {
+            const int16_t q[4] = {quantize(verts[i].x, centre.x), quantize(verts[i].y, centre.y),
+                                  quantize(verts[i].z, centre.z), 0};
+            std::memcpy(dst, q, sizeof(q));
+        });
+        stream.WriteElements(normals.size(), normStride, [&](size_t i, uint8_t* dst) {
+            auto snorm = [](float v) {
+                return static_cast<uint8_t>(static_cast<int8_t>(std::lround(std::clamp(v, -1.0f, 1.0f) * 127.0f)));
+            };
+            dst[0] = snorm(normals[i].x);
+            dst[1] = snorm(normals[i].y);
+            dst[2] = snorm(normals[i].z);
+            dst[3] = 0;
+        });
+    } else {
+        stream.Write(verts.data(), posBytes);
+        stream.Write(normals.data(), normBytes);
+    }
+
+    if (shortIndices) {
+        stream.WriteElements(tris.size() * 3, sizeof(uint16_t), [&](size_t i, uint8_t* dst) {
+            const uint16_t index = static_cast<uint16_t>(tris[i / 3][i % 3]);
+            std::memcpy(dst, &index, sizeof(index));
+        });
+    } else {
+        stream.Write(tris.data(), idxBytes);
+    }
+    stream.Pad(0);
+
+    for (const auto& target : targets) {
+        stream.Write(target.indices.data(), target.indices.size() * sizeof(uint32_t));
+        if (compact) {
+            stream.WriteElements(target.deltas.size(), sizeof(Vec3), [&](size_t i, uint8_t* dst) {
+                const Vec3 d = {target.deltas[i].x * deltaScale, target.deltas[i].y * deltaScale,
+                                target.deltas[i].z * deltaScale};
+                std::memcpy(dst, &d, sizeof(d));
+            });
+        } else {
+            stream.Write(target.deltas.data(), target.deltas.size() * sizeof(Vec3));
+        }
+    }
+    stream.Flush();
+    return out.good();
+}
+
+// Deflate bit stream; bits are packed least significant first.
+struct DeflateBits {
+    std::vector<uint8_t> bytes;
+    uint64_t acc = 0;
+    int count = 0;
+
+    void Put(uint32_t bits, int n) {
+        acc |= static_cast<uint64_t>(bits) << count;
+        count += n;
+        while (count >= 8) {
+            bytes.push_back(static_cast<uint8_t>(acc));
+            acc >>= 8;
+            count -= 8;
+        }
+    }
+
+    // Huffman codes are defined most significant bit first.
+    void PutCode(uint32_t code, int n) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < n; ++i) reversed |= ((code >> i) & 1u) << (n - 1 - i);
+        Put(reversed, n);
+    }
+
+    void Align() {
+        if (count > 0) Put(0, 8 - count);
+    }
+};
+
+static void PutFixedSymbol(DeflateBits& out, int sym) {
+    if (sym < 144) {
+        out.PutCode(0x30 + sym, 8);
+    } else if (sym < 256) {
+        out.PutCode(0x190 + sym - 144, 9);
+    } else if (sym < 280) {
+        out.PutCode(sym - 256, 7);
+    } else {
+        out.PutCode(0xc0 + sym - 280, 8);
+    }
+}
+
+static void PutFixedMatch(DeflateBits& out, int length, int distance) {
+    static const uint16_t kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27,
+                                             31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                             2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t kDistBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                           193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                           6145, 8193, 12289, 16385, 24577};
+    static const uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                           6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    int lc = static_cast<int>(std::upper_bound(kLengthBase, kLengthBase + 29, length) - kLengthBase) - 1;
+    if (length == 258) lc = 28;
+    PutFixedSymbol(out, 257 + lc);
+    if (kLengthExtra[lc]) out.Put(static_cast<uint32_t>(length - kLengthBase[lc]), kLengthExtra[lc]);
+
+    int dc = static_cast<int>(std::upper_bound(kDistBase, kDistBase + 30, distance) - kDistBase) - 1;
+    out.PutCode(static_cast<uint32_t>(dc), 5);
+    if (kDistExtra[dc]) out.Put(static_cast<uint32_t>(distance - kDistBase[dc]), kDistExtra[dc]);
+}
+
+// First level that tries every PNG filter per row and hashes every position.
+constexpr int kPngFullLevel = 4;
+
+// Compresses one independent piece of a deflate stream. Every piece but the
+// last ends byte-aligned with an empty stored block (a sync flush), so pieces
+// compressed in parallel concatenate into one valid stream. Level 0 stores the
+// data; levels 1-9 run LZ77 over a hash chain of up to 2^level candidates and
+// emit fixed Huffman codes. Below kPngFullLevel positions inside a match are
+// not hashed, as in zlib's fast levels.
+static void DeflatePiece(const uint8_t* data, size_t len, int level, bool last, DeflateBits& out) {
+    if (level <= 0) {
+        size_t pos = 0;
+        do {
+            const size_t n = std::min<size_t>(65535, len - pos);
+            const bool final = last && pos + n == len;
+            out.Put(final ? 1u : 0u, 1);
+            out.Put(0, 2);
+            out.Align();
+            out.Put(static_cast<uint32_t>(n), 16);
+            out.Put(static_cast<uint32_t>(~n & 0xffff), 16);
+            out.bytes.insert(out.bytes.end(), data + pos, data + pos + n);
+            pos += n;
+        } while (pos < len);
+        return;
+    }
+
+    constexpr int kHashBits = 15;
+    constexpr size_t kWindow = 32768;
+    constexpr int kMaxMatch = 258;
+    const int maxChain = 1 << std::min(level, 9);
+    std::vector<int32_t> head(size_t(1) << kHashBits, -1);
+    std::vector<int32_t> prev(len);
+    auto hash = [&](size_t i) {
+        uint32_t v = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16);
+        return (v * 2654435761u) >> (32 - kHashBits);
+    };
+    auto insert = [&](size_t i) {
+        uint32_t h = hash(i);
+        prev[i] = head[h];
+        head[h] = static_cast<int32_t>(i);
+    };
+
+    out.Put(last ? 1u : 0u, 1);
+    out.Put(1, 2);
+    size_t i = 0;
+    while (i + 3 <= len) {
+        const int limit = static_cast<int>(std::min<size_t>(kMaxMatch, len - i));
+        int bestLen = 0;
+        size_t bestDist = 0;
+        int chain = maxChain;
+        for (int32_t cand = head[hash(i)]; cand >= 0 && i - static_cast<size_t>(cand) <= kWindow && chain-- > 0; cand = prev[cand]) {
+            const uint8_t* a = data + cand;
+            const uint8_t* b = data + i;
+            if (a[bestLen] != b[bestLen]) continue;
+            int n = 0;
+            while (n < limit && a[n] == b[n]) ++n;
+            if (n > bestLen) {
+                bestLen = n;
+                bestDist = i - static_cast<size_t>(cand);
+                if (n == limit) break;
+            }
+        }
+
+        insert(i);
+        if (bestLen >= 3) {
+            PutFixedMatch(out, bestLen, static_cast<int>(bestDist));
+            const size_t end = i + bestLen;
+            if (level < kPngFullLevel) {
+                i = end;
+                continue;
+            }
+            for (++i; i < end; ++i) {
+                if (i + 3 <= len) insert(i);
+            }
+        } else {
+            PutFixedSymbol(out, data[i]);
+            ++i;
+        }
+    }
+    for (; i < len; ++i) PutFixedSymbol(out, data[i]);
+    PutFixedSymbol(out, 256);
+
+    if (last) {
+        out.Align();
+    } else {
+        out.Put(0, 3);
+        out.Align();
+        out.Put(0x0000, 16);
+        out.Put(0xffff, 16);
+    }
+}
+
+static uint32_t Adler32(const uint8_t* data, size_t len) {
+    uint32_t a = 1;
+    uint32_t b = 0;
+    while (len > 0) {
+        const size_t n = std::min<size_t>(len, 5552);
+        for (size_t i = 0; i < n; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += n;
+        len -= n;
+    }
+    return (b << 16) | a;
+}
+
+// Checksum of two concatenated buffers from the checksums of each.
+static uint32_t Adler32Combine(uint32_t first, uint32_t second, size_t secondLen) {
+    constexpr uint32_t kBase = 65521;
+    const uint32_t rem = static_cast<uint32_t>(secondLen % kBase);
+    uint32_t sum1 = first & 0xffff;
+    uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(rem) * sum1) % kBase);
+    sum1 += (second & 0xffff) + kBase - 1;
+    sum2 += (first >> 16) + (second >> 16) + kBase - rem;
+    if (sum1 >= kBase) sum1 -= kBase;
+    if (sum1 >= kBase) sum1 -= kBase;
+    if (sum2 >= 2 * kBase) sum2 -= 2 * kBase;
+    if (sum2 >= kBase) sum2 -= kBase;
+    return (sum2 << 16) | sum1;
+}
+
+static uint32_t Crc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void AppendBigEndian(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(static_cast<uint8_t>(v >> 24));
+    out.push_back(static_cast<uint8_t>(v >> 16));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+static void AppendPngChunk(std::vector<uint8_t>& png, const char type[4], const uint8_t* data, size_t len) {
+    AppendBigEndian(png, static_cast<uint32_t>(len));
+    const size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data, data + len);
+    AppendBigEndian(png, Crc32(png.data() + start, len + 4));
+}
+
+// Rows per independently filtered and compressed PNG piece.
+constexpr int kPngPieceRows = 64;
+
+// Encodes RGBA8 pixels as PNG. Row pieces are filtered and deflated on the
+// worker pool; must not be called from inside a pool task.
+std::vector<uint8_t> EncodePng(const uint8_t* rgba, int w, int h, int level) {
+    const size_t rowBytes = static_cast<size_t>(w) * 4;
+    const size_t lineBytes = rowBytes + 1;
+    const size_t pieces = (static_cast<size_t>(h) + kPngPieceRows - 1) / kPngPieceRows;
+    std::vector<DeflateBits> deflated(pieces);
+    std::vector<uint32_t> adlers(pieces);
+
+    WorkerPool().ParallelFor(pieces, [&](size_t p) {
+        const int y0 = static_cast<int>(p) * kPngPieceRows;
+        const int y1 = std::min(h, y0 + kPngPieceRows);
+        std::vector<uint8_t> filtered(lineBytes * (y1 - y0));
+        std::array<std::vector<uint8_t>, 5> trial;
+        for (auto& t : trial) t.resize(rowBytes);
+
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t* row = rgba + static_cast<size_t>(y) * rowBytes;
+            const uint8_t* up = y > 0 ? row - rowBytes : nullptr;
+            uint8_t* line = filtered.data() + lineBytes * (y - y0);
+
+            // Stored output gains nothing from filtering; fast levels always
+            // use Up, the others pick the filter with the smallest sum of
+            // absolute residuals.
+            int best = 0;
+            if (level > 0 && level < kPngFullLevel) {
+                best = up ? 2 : 1;
+                uint8_t* out = trial[best].data();
+                for (size_t i = 0; i < rowBytes; ++i) {
+                    out[i] = static_cast<uint8_t>(row[i] - (up ? up[i] : (i >= 4 ? row[i - 4] : 0)));
+                }
+            } else if (level > 0) {
+                uint32_t bestCost = std::numeric_limits<uint32_t>::max();
+                for (int f = 0; f < 5; ++f) {
+                    uint8_t* out = trial[f].data();
+                    uint32_t cost = 0;
+                    for (size_t i = 0; i < rowBytes; ++i) {
+                        const int a = i >= 4 ? row[i - 4] : 0;
+                        const int b = up ? up[i] : 0;
+                        const int c = (i >= 4 && up) ? up[i - 4] : 0;
+                        int pred = 0;
+                        switch (f) {
+                        case 1: pred = a; break;
+                        case 2: pred = b; break;
+                        case 3: pred = (a + b) >> 1; break;
+                        case 4: {
+                            const int pa = std::abs(b - c);
+                            const int pb = std::abs(a - c);
+                            const int pc = std::abs(a + b - 2 * c);
+                            pred = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                            break;
+                        }
+                        default: break;
+                        }
+                        out[i] = static_cast<uint8_t>(row[i] - pred);
+                        cost += static_cast<uint32_t>(std::abs(static_cast<int8_t>(out[i])));
+                    }
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        best = f;
+                    }
+                }
+            }
+
+            line[0] = static_cast<uint8_t>(best);
+            std::memcpy(line + 1, best == 0 ? row : trial[best].data(), rowBytes);
+        }
+
+        adlers[p] = Adler32(filtered.data(), filtered.size());
+        DeflatePiece(filtered.data(), filtered.size(), level, p + 1 == pieces, deflated[p]);
+    });
+
+    std::vector<uint8_t> idat = {0x78, 0x01};
+    uint32_t adler = 1;
+    for (size_t p = 0; p < pieces; ++p) {
+        idat.insert(idat.end(), deflated[p].bytes.begin(), deflated[p].bytes.end());
+        const int rows = std::min(h - static_cast<int>(p) * kPngPieceRows, kPngPieceRows);
+        adler = p == 0 ? adlers[p] : Adler32Combine(adler, adlers[p], lineBytes * rows);
+    }
+    AppendBigEndian(idat, adler);
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<uint8_t> header;
+    AppendBigEndian(header, static_cast<uint32_t>(w));
+    AppendBigEndian(header, static_cast<uint32_t>(h));
+    header.insert(header.end(), {8, 6, 0, 0, 0}); // 8-bit RGBA, no interlace
+    AppendPngChunk(png, "IHDR", header.data(), header.size());
+    AppendPngChunk(png, "IDAT", idat.data(), idat.size());
+    AppendPngChunk(png, "IEND", nullptr, 0);
+    return png;
+}
+
+std::vector<uint8_t> EncodeQoi(const uint8_t* rgba, int w, int h) {
+    qoi_desc desc;
+    desc.width = static_cast<unsigned>(w);
+    desc.height = static_cast<unsigned>(h);
+    desc.channels = 4;
+    desc.colorspace = QOI_SRGB;
+    int len = 0;
+    void* encoded = qoi_encode(rgba, &desc, &len);
+    if (!encoded) return {};
+    std::vector<uint8_t> out(static_cast<uint8_t*>(encoded), static_cast<uint8_t*>(encoded) + len);
+    STBIW_FREE(encoded);
+    return out;
+}
+
+static bool WriteImageFile(const std::string& path, const std::vector<uint8_t>& encoded) {
+    if (encoded.empty()) return false;
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+    return out.good();
+}
+
+// Format of an output image: --format when given, else the file extension.
+static ImageFormat OutputImageFormat(const std::string& path, const std::string& formatName) {
+    ImageFormat format = ImageFormat::Png;
+    if (!formatName.empty() && ParseImageFormat(formatName, format)) return format;
+    const std::string ext = fs::path(path).extension().string();
+    if (!ext.empty()) ParseImageFormat(ext.substr(1), format);
+    return format;
+}
+
+static std::vector<uint8_t> EncodeImage(const std::string& path, const Args& args, const uint8_t* rgba, int w, int h) {
+    const bool qoi = OutputImageFormat(path, args.imageFormat) == ImageFormat::Qoi;
+    return qoi ? EncodeQoi(rgba, w, h) : EncodePng(rgba, w, h, args.pngLevel);
+}
+
+// Halves a premultiplied RGBA8 image with a 2x2 box filter, rounding to
+// nearest. A trailing odd row or column is dropped.
+static void DownsampleBox(const uint8_t* src, int w, int h, std::vector<uint8_t>& dst) {
+    const int outW = w / 2;
+    const int outH = h / 2;
+    const size_t srcStride = static_cast<size_t>(w) * 4;
+    dst.resize(static_cast<size_t>(outW) * outH * 4);
+    for (int y = 0; y < outH; ++y) {
+        const uint8_t* row0 = src + srcStride * (2 * y);
+        const uint8_t* row1 = row0 + srcStride;
+        uint8_t* out = dst.data() + static_cast<size_t>(outW) * 4 * y;
+        int x = 0;
+#ifdef BSRENDER_X86_SIMD
+        // Two output pixels per step: widen both rows to 16 bits, add them,
+        // then add horizontal neighbours by pairing the 64-bit halves.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(2);
+        for (; x + 2 <= outW; x += 2) {
+            const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+            const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+            const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero), _mm_unpacklo_epi8(r1, zero));
+            const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero), _mm_unpackhi_epi8(r1, zero));
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(sum, sum));
+        }
+#endif
+        for (; x < outW; ++x) {
+            for (int c = 0; c < 4; ++c) {
+                const int sum = row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c];
+                out[x * 4 + c] = static_cast<uint8_t>((sum + 2) >> 2);
+            }
+        }
+    }
+}
+
+// Converts premultiplied RGBA8 back to the straight alpha image files use.
+static void Unpremultiply(const std::vector<uint8_t>& src, std::vector<uint8_t>& dst) {
+    dst.resize(src.size());
+    for (size_t i = 0; i < src.size(); i += 4) {
+        const uint32_t a = src[i + 3];
+        for (int c = 0; c < 3; ++c) {
+            dst[i + c] = a == 0 ? 0 : static_cast<uint8_t>(std::min<uint32_t>(255, (src[i + c] * 255u + a / 2) / a));
+        }
+        dst[i + 3] = static_cast<uint8_t>(a);
+    }
+}
+
+// Output path of a mip level: "<stem>_<width><ext>".
+static std::string MipImagePath(const std::string& path, int width) {
+    fs::path p(path);
+    return (p.parent_path() / (p.stem().string() + "_" + std::to_string(width) + p.extension().string())).string();
+}
+
+// Writes the image and, with --mips, its box-filtered half-size levels.
+// Rendered pixels are either opaque or transparent black, so the full-size
+// image already is premultiplied and filters without dark fringes.
+static bool WriteImage(const std::string& path, const Args& args, const uint8_t* rgba, int w, int h) {
+    if (!WriteImageFile(path, EncodeImage(path, args, rgba, w, h))) return false;
+
+    std::vector<uint8_t> level;
+    std::vector<uint8_t> next;
+    std::vector<uint8_t> straight;
+    const uint8_t* src = rgba;
+    for (int mip = 1; mip <= args.mipLevels && w >= 2 && h >= 2; ++mip) {
+        DownsampleBox(src, w, h, next);
+        w /= 2;
+        h /= 2;
+        level.swap(next);
+        src = level.data();
+
+        Unpremultiply(level, straight);
+        const std::string mipPath = MipImagePath(path, w);
+        if (!WriteImageFile(mipPath, EncodeImage(mipPath, args, straight.data(), w, h))) return false;
+        if (args.verbose) std::cout << "Mip " << w << "x" << h << ": " << mipPath << "\n";
+    }
+    return true;
+}
+
+struct DrawVertex {
+    float sx = 0.0f;
+    float sy = 0.0f;
+    float depth = 0.0f;
+};
+
+// Screen tiles are kRasterTile pixels square. Each tile is shaded by one task
+// with its own depth buffer, so tasks never write the same memory.
+constexpr int kRasterTile = 64;
+
+// Sub-pixel precision of the fixed-point edge functions, and the bound on the
+// bounding box extent (in pixels, exclusive) for which edge values stay within
+// int32 up to the last 8-wide block of a row: 2 * ((119 + 8) * 256)^2 < 2^31.
+// Larger triangles use the float edge test.
+constexpr int kSubPixelBits = 8;
+constexpr int kFixedMaxExtent = 120;
+constexpr uint32_t kNoTriangle = std::numeric_limits<uint32_t>::max();
+
+// A front-facing triangle ready for rasterization. Edge k is
+// E(x, y) = edgeC[k] + edgeA[k] * (x - x0) + edgeB[k] * (y - y0) at the centre
+// of pixel (x, y), oriented so covered pixels have all three E >= 0. Depth is
+// the plane depthC + depthDx * (x - x0) + depthDy * (y - y0).
+struct TriangleSetup {
+    DrawVertex v0;
+    DrawVertex v1;
+    DrawVertex v2;
+    uint32_t tri = 0; // index into the triangle list, for the vertex normals
+    int x0 = 0;
+    int x1 = -1;
+    int y0 = 0;
+    int y1 = -1;
+    float denom = 0.0f;
+    bool fixedPoint = false;
+    int32_t edgeA[3] = {};
+    int32_t edgeB[3] = {};
+    int32_t edgeC[3] = {};
+    float depthC = 0.0f;
+    float depthDx = 0.0f;
+    float depthDy = 0.0f;
+
+    // Float barycentrics of the pixel centre, as used for shading.
+    void Barycentrics(int x, int y, float& w0, float& w1, float& w2) const {
+        float px = static_cast<float>(x) + 0.5f;
+        float py = static_cast<float>(y) + 0.5f;
+        w0 = ((v1.sy - v2.sy) * (px - v2.sx) + (v2.sx - v1.sx) * (py - v2.sy)) / denom;
+        w1 = ((v2.sy - v0.sy) * (px - v2.sx) + (v0.sx - v2.sx) * (py - v2.sy)) / denom;
+        w2 = 1.0f - w0 - w1;
+    }
+};
+
+// Fills in the edge functions and depth plane of a triangle whose screen
+// vertices, bounding box and float denominator are set. Returns false if the
+// triangle is degenerate at sub-pixel precision.
+static bool SetupEdges(TriangleSetup& setup) {
+    const DrawVertex* v[3] = {&setup.v0, &setup.v1, &setup.v2};
+
+    float w0 = 0.0f;
+    float w1 = 0.0f;
+    float w2 = 0.0f;
+    setup.Barycentrics(setup.x0, setup.y0, w0, w1, w2);
+    setup.depthC = v[0]->depth * w0 + v[1]->depth * w1 + v[2]->depth * w2;
+    const float dw0dx = (v[1]->sy - v[2]->sy) / setup.denom;
+    const float dw1dx = (v[2]->sy - v[0]->sy) / setup.denom;
+    const float dw0dy = (v[2]->sx - v[1]->sx) / setup.denom;
+    const float dw1dy = (v[0]->sx - v[2]->sx) / setup.denom;
+    setup.depthDx = dw0dx * (v[0]->depth - v[2]->depth) + dw1dx * (v[1]->depth - v[2]->depth);
+    setup.depthDy = dw0dy * (v[0]->depth - v[2]->depth) + dw1dy * (v[1]->depth - v[2]->depth);
+
+    setup.fixedPoint = setup.x1 - setup.x0 < kFixedMaxExtent && setup.y1 - setup.y0 < kFixedMaxExtent;
+    if (!setup.fixedPoint) return true;
+
+    // Vertices snapped to the sub-pixel grid relative to the box corner; pixel
+    // centres sit at half a pixel.
+    constexpr float kOne = static_cast<float>(1 << kSubPixelBits);
+    constexpr int32_t kHalf = 1 << (kSubPixelBits - 1);
+    int32_t fx[3];
+    int32_t fy[3];
+    for (int i = 0; i < 3; ++i) {
+        fx[i] = static_cast<int32_t>(std::lround((v[i]->sx - setup.x0) * kOne));
+        fy[i] = static_cast<int32_t>(std::lround((v[i]->sy - setup.y0) * kOne));
+    }
+
+    // Edge k is opposite vertex k: E_k = (yj - yl) * (px - xl) + (xl - xj) * (py - yl).
+    static const int kOther[3][2] = {{1, 2}, {2, 0}, {0, 1}};
+    int64_t area = 0;
+    for (int k = 0; k < 3; ++k) {
+        const int j = kOther[k][0];
+        const int l = kOther[k][1];
+        const int32_t a = fy[j] - fy[l];
+        const int32_t b = fx[l] - fx[j];
+        setup.edgeA[k] = a << kSubPixelBits;
+        setup.edgeB[k] = b << kSubPixelBits;
+        setup.edgeC[k] = a * (kHalf - fx[l]) + b * (kHalf - fy[l]);
+        area += setup.edgeC[k];
+    }
+    if (area == 0) return false;
+    if (area < 0) {
+        for (int k = 0; k < 3; ++k) {
+            setup.edgeA[k] = -setup.edgeA[k];
+            setup.edgeB[k] = -setup.edgeB[k];
+            setup.edgeC[k] = -setup.edgeC[k];
+        }
+    }
+    return true;
+}
+
+// Nearest triangle per pixel of one tile. Rows are padded so 8-wide blocks at
+// the right edge stay inside the arrays.
+struct TileDepth {
+    static constexpr int kStride = kRasterTile + 8;
+    std::array<float, kStride * kRasterTile> depth;
+    std::array<uint32_t, kStride * kRasterTile> tri;
+
+    void Clear() {
+        depth.fill(-std::numeric_limits<float>::infinity());
+        tri.fill(kNoTriangle);
+    }
+};
+
+// Depth-tests one triangle against a tile over the pixel box [x0, x1] x [y0, y1]
+// (tile-clipped, in image coordinates). Covered pixels are found 8 at a time
+// with the fixed-point edge functions; 8x1 blocks wholly outside one edge are
+// skipped without per-pixel work.
+static void RasterizeDepth(const TriangleSetup& setup, uint32_t id, int tileX0, int tileY0, int x0, int x1, int y0,
+                           int y1, TileDepth& target) {
+    for (int y = y0; y <= y1; ++y) {
+        float* depthRow = target.depth.data() + (y - tileY0) * TileDepth::kStride - tileX0;
+        uint32_t* triRow = target.tri.data() + (y - tileY0) * TileDepth::kStride - tileX0;
+        const float rowDepth = setup.depthC + setup.depthDy * static_cast<float>(y - setup.y0);
+
+        if (!setup.fixedPoint) {
+            for (int x = x0; x <= x1; ++x) {
+                float w0 = 0.0f;
+                float w1 = 0.0f;
+                float w2 = 0.0f;
+                setup.Barycentrics(x, y, w0, w1, w2);
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+                const float depth = rowDepth + setup.depthDx * static_cast<float>(x - setup.x0);
+                if (depth <= depthRow[x]) continue;
+                depthRow[x] = depth;
+                triRow[x] = id;
+            }
+            continue;
+        }
+
+        int32_t e[3];
+#ifdef BSRENDER_X86_SIMD
+        __m128i laneStepLo[3]; // edge steps to lanes 0-3
+        __m128i laneStepHi[3]; // from lanes 0-3 to lanes 4-7
+#endif
+        for (int k = 0; k < 3; ++k) {
+            const int32_t a = setup.edgeA[k];
+            e[k] = setup.edgeC[k] + a * (x0 - setup.x0) + setup.edgeB[k] * (y - setup.y0);
+#ifdef BSRENDER_X86_SIMD
+            laneStepLo[k] = _mm_setr_epi32(0, a, 2 * a, 3 * a);
+            laneStepHi[k] = _mm_set1_epi32(4 * a);
+#endif
+        }
+
+        for (int x = x0; x <= x1; x += 8) {
+            const int lanes = std::min(8, x1 - x + 1);
+            bool outside = false;
+            for (int k = 0; k < 3; ++k) {
+                // Linear along the row, so the block's maximum is at one of its ends.
+                const int32_t last = e[k] + setup.edgeA[k] * (lanes - 1);
+                if (e[k] < 0 && last < 0) outside = true;
+            }
+            if (!outside) {
+                const float blockDepth = rowDepth + setup.depthDx * static_cast<float>(x - setup.x0);
+#ifdef BSRENDER_X86_SIMD
+                const __m128i laneIndexLo = _mm_setr_epi32(0, 1, 2, 3);
+                const __m128i laneIndexHi = _mm_setr_epi32(4, 5, 6, 7);
+                const __m128i laneCount = _mm_set1_epi32(lanes);
+                __m128i coverLo = _mm_cmplt_epi32(laneIndexLo, laneCount);
+                __m128i coverHi = _mm_cmplt_epi32(laneIndexHi, laneCount);
+                for (int k = 0; k < 3; ++k) {
+                    const __m128i lo = _mm_add_epi32(_mm_set1_epi32(e[k]), laneStepLo[k]);
+                    const __m128i hi = _mm_add_epi32(lo, laneStepHi[k]);
+                    coverLo = _mm_and_si128(coverLo, _mm_cmpgt_epi32(lo, _mm_set1_epi32(-1)));
+                    coverHi = _mm_and_si128(coverHi, _mm_cmpgt_epi32(hi, _mm_set1_epi32(-1)));
+                }
+                if (_mm_movemask_epi8(_mm_or_si128(coverLo, coverHi)) != 0) {
+                    const __m128 dx = _mm_set1_ps(setup.depthDx);
+                    const __m128 zLo = _mm_add_ps(_mm_set1_ps(blockDepth),
+                                                  _mm_mul_ps(dx, _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)));
+                    const __m128 zHi = _mm_add_ps(_mm_set1_ps(blockDepth),
+                                                  _mm_mul_ps(dx, _mm_setr_ps(4.0f, 5.0f, 6.0f, 7.0f)));
+                    const __m128i idv = _mm_set1_epi32(static_cast<int32_t>(id));
+                    float* depth = depthRow + x;
+                    uint32_t* tri = triRow + x;
+                    const __m128 oldLo = _mm_loadu_ps(depth);
+                    const __m128 oldHi = _mm_loadu_ps(depth + 4);
+                    const __m128 passLo = _mm_and_ps(_mm_castsi128_ps(coverLo), _mm_cmpgt_ps(zLo, oldLo));
+                    const __m128 passHi = _mm_and_ps(_mm_castsi128_ps(coverHi), _mm_cmpgt_ps(zHi, oldHi));
+                    _mm_storeu_ps(depth, _mm_or_ps(_mm_and_ps(passLo, zLo), _mm_andnot_ps(passLo, oldLo)));
+                    _mm_storeu_ps(depth + 4, _mm_or_ps(_mm_and_ps(passHi, zHi), _mm_andnot_ps(passHi, oldHi)));
+                    const __m128i triLo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tri));
+                    const __m128i triHi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tri + 4));
+                    const __m128i maskLo = _mm_castps_si128(passLo);
+                    const __m128i maskHi = _mm_castps_si128(passHi);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(tri),
+                                     _mm_or_si128(_mm_and_si128(maskLo, idv), _mm_andnot_si128(maskLo, triLo)));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(tri + 4),
+                                     _mm_or_si128(_mm_and_si128(maskHi, idv), _mm_andnot_si128(maskHi, triHi)));
+                }
+#else
+                for (int lane = 0; lane < lanes; ++lane) {
+                    if (e[0] + setup.edgeA[0] * lane < 0 || e[1] + setup.edgeA[1] * lane < 0 ||
+                        e[2] + setup.edgeA[2] * lane < 0) {
+                        continue;
+                    }
+                    const float depth = blockDepth + setup.depthDx * static_cast<float>(lane);
+                    if (depth <= depthRow[x + lane]) continue;
+                    depthRow[x + lane] = depth;
+                    triRow[x + lane] = id;
+                }
+#endif
+            }
+            if (x + 8 <= x1) {
+                for (int k = 0; k < 3; ++k) e[k] += setup.edgeA[k] * 8;
+            }
+        }
+    }
+}
+
+// Row-major 3x3 matrix; Apply computes m * v.
+struct Mat3 {
+    float m[9] = {};
+
+    Vec3 Apply(const Vec3& v) const {
+        return {m[0] * v.x + m[1] * v.y + m[2] * v.z, m[3] * v.x + m[4] * v.y + m[5] * v.z,
+                m[6] * v.x + m[7] * v.y + m[8] * v.z};
+    }
+
+    Vec3 ApplyTransposed(const Vec3& v) const {
+        return {m[0] * v.x + m[3] * v.y + m[6] * v.z, m[1] * v.x + m[4] * v.y + m[7] * v.z,
+                m[2] * v.x + m[5] * v.y + m[8] * v.z};
+    }
+};
+
+// RotateYawPitchRoll as one matrix: its columns are the rotated basis vectors.
+static Mat3 YawPitchRollMatrix(float yaw, float pitch, float roll) {
+    const Vec3 cx = RotateYawPitchRoll({1.0f, 0.0f, 0.0f}, yaw, pitch, roll);
+    const Vec3 cy = RotateYawPitchRoll({0.0f, 1.0f, 0.0f}, yaw, pitch, roll);
+    const Vec3 cz = RotateYawPitchRoll({0.0f, 0.0f, 1.0f}, yaw, pitch, roll);
+    return {{cx.x, cy.x, cz.x, cx.y, cy.y, cz.y, cx.z, cy.z, cz.z}};
+}
+
+// Vertex positions as one float stream per component.
+struct VertexStreams {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    void Resize(size_t count) {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+    }
+};
+
+// Transforms vertices [begin, end) of `in` by `m` into `out` and returns the
+// bounds of the result in the x/z (screen) plane as {minX, minZ, maxX, maxZ}.
+static std::array<float, 4> TransformVertices(const Mat3& m, const VertexStreams& in, VertexStreams& out,
+                                              size_t begin, size_t end) {
+    float minX = std::numeric_limits<float>::max();
+    float minZ = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest();
+    float maxZ = std::numeric_limits<float>::lowest();
+    size_t i = begin;
+#ifdef BSRENDER_X86_SIMD
+    if (end - begin >= 4) {
+        __m128 row[9];
+        for (int k = 0; k < 9; ++k) row[k] = _mm_set1_ps(m.m[k]);
+        __m128 minX4 = _mm_set1_ps(minX);
+        __m128 minZ4 = _mm_set1_ps(minZ);
+        __m128 maxX4 = _mm_set1_ps(maxX);
+        __m128 maxZ4 = _mm_set1_ps(maxZ);
+        for (; i + 4 <= end; i += 4) {
+            const __m128 px = _mm_loadu_ps(in.x.data() + i);
+            const __m128 py = _mm_loadu_ps(in.y.data() + i);
+            const __m128 pz = _mm_loadu_ps(in.z.data() + i);
+            const __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(row[0], px), _mm_mul_ps(row[1], py)),
+                                         _mm_mul_ps(row[2], pz));
+            const __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(row[3], px), _mm_mul_ps(row[4], py)),
+                                         _mm_mul_ps(row[5], pz));
+            const __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(row[6], px), _mm_mul_ps(row[7], py)),
+                                         _mm_mul_ps(row[8], pz));
+            _mm_storeu_ps(out.x.data() + i, rx);
+            _mm_storeu_ps(out.y.data() + i, ry);
+            _mm_storeu_ps(out.z.data() + i, rz);
+            minX4 = _mm_min_ps(minX4, rx);
+            maxX4 = _mm_max_ps(maxX4, rx);
+            minZ4 = _mm_min_ps(minZ4, rz);
+            maxZ4 = _mm_max_ps(maxZ4, rz);
+        }
+        alignas(16) float lanes[4][4];
+        _mm_store_ps(lanes[0], minX4);
+        _mm_store_ps(lanes[1], minZ4);
+        _mm_store_ps(lanes[2], maxX4);
+        _mm_store_ps(lanes[3], maxZ4);
+        for (int k = 0; k < 4; ++k) {
+            minX = std::min(minX, lanes[0][k]);
+            minZ = std::min(minZ, lanes[1][k]);
+            maxX = std::max(maxX, lanes[2][k]);
+            maxZ = std::max(maxZ, lanes[3][k]);
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        const float px = in.x[i];
+        const float py = in.y[i];
+        const float pz = in.z[i];
+        const float rx = m.m[0] * px + m.m[1] * py + m.m[2] * pz;
+        const float rz = m.m[6] * px + m.m[7] * py + m.m[8] * pz;
+        out.x[i] = rx;
+        out.y[i] = m.m[3] * px + m.m[4] * py + m.m[5] * pz;
+        out.z[i] = rz;
+        minX = std::min(minX, rx);
+        maxX = std::max(maxX, rx);
+        minZ = std::min(minZ, rz);
+        maxZ = std::max(maxZ, rz);
+    }
+    return {minX, minZ, maxX, maxZ};
+}
+
+// One view in flight: its view-space and screen-space vertex streams, triangle
+// setups, tile bins and image.
+struct ViewRaster {
+    Mat3 rotation;
+    Vec3 light; // light direction in model space, for the unrotated normals
+    VertexStreams rotated;
+    std::vector<float> sx;
+    std::vector<float> sy;
+    std::vector<std::array<float, 4>> chunkBounds;
+    std::vector<TriangleSetup> setups;
+    std::vector<std::vector<uint32_t>> bins;
+    std::vector<uint8_t> img;
+};
+
+// Renders the mesh from every view into size x size RGBA images. Each view
+// transforms the vertices once with its composed rotation, into SoA streams
+// with their bounds, and projects each vertex to the screen once; triangle
+// setup reads the projected vertices. Vertex normals are computed once by the
+// caller and stay in model space: the light is rotated into it instead. Each
+// stage runs as one pool pass over all views, so views render concurrently and
+// a single view still spreads over every worker.
+bool RenderViews(const std::vector<Vec3>& verts,
+                 const std::vector<Vec3>& modelNormals,
+                 const std::vector<std::array<uint32_t, 3>>& tris,
+                 int size,
+                 const std::vector<ViewAngles>& views,
+                 std::vector<std::vector<uint8_t>>& outImages) {
+    if (verts.empty() || tris.empty() || views.empty()) return false;
+
+    ThreadPool& pool = WorkerPool();
+    const size_t viewCount = views.size();
+    std::vector<ViewRaster> rasters(viewCount);
+
+    // Runs fn(view, chunk) for every chunk of every view in one pool pass.
+    auto forEachViewChunk = [&](size_t chunksPerView, auto&& fn) {
+        pool.ParallelFor(viewCount * chunksPerView, [&](size_t i) { fn(i / chunksPerView, i % chunksPerView); });
+    };
+
+    // Model positions as SoA streams, shared by every view.
+    constexpr size_t kVertexChunk = 16384;
+    const size_t vertexChunks = (verts.size() + kVertexChunk - 1) / kVertexChunk;
+    VertexStreams model;
+    model.Resize(verts.size());
+    pool.ParallelFor(vertexChunks, [&](size_t c) {
+        const size_t end = std::min(verts.size(), (c + 1) * kVertexChunk);
+        for (size_t i = c * kVertexChunk; i < end; ++i) {
+            model.x[i] = verts[i].x;
+            model.y[i] = verts[i].y;
+            model.z[i] = verts[i].z;
+        }
+    });
+
+    const Vec3 lightDir = Normalize({0.3f, -0.4f, 1.0f});
+    const Vec3 viewDir = Normalize({0.0f, -1.0f, 0.0f});
+
+    // Transform in chunks; per-chunk bounds reduce to the same min/max.
+    for (size_t v = 0; v < viewCount; ++v) {
+        ViewRaster& view = rasters[v];
+        view.rotation = YawPitchRollMatrix(views[v].yawDeg * 3.14159265f / 180.0f,
+                                           views[v].pitchDeg * 3.14159265f / 180.0f,
+                                           views[v].rollDeg * 3.14159265f / 180.0f);
+        view.light = view.rotation.ApplyTransposed(lightDir);
+        view.rotated.Resize(verts.size());
+        view.sx.resize(verts.size());
+        view.sy.resize(verts.size());
+        view.chunkBounds.resize(vertexChunks);
+    }
+    forEachViewChunk(vertexChunks, [&](size_t v, size_t c) {
+        ViewRaster& view = rasters[v];
+        view.chunkBounds[c] = TransformVertices(view.rotation, model, view.rotated, c * kVertexChunk,
+                                                std::min(verts.size(), (c + 1) * kVertexChunk));
+    });
+
+    int w = size;
+    int h = size;
+    int pad = static_cast<int>(size * 0.05f);
+
+    struct Projection {
+        float scale = 1.0f;
+        float cx = 0.0f;
+        float cy = 0.0f;
+    };
+    std::vector<Projection> projections(viewCount);
+    for (size_t v = 0; v < viewCount; ++v) {
+        float minX = std::numeric_limits<float>::max();
+        float minY = std::numeric_limits<float>::max();
+        float maxX = std::numeric_limits<float>::lowest();
+        float maxY = std::numeric_limits<float>::lowest();
+        for (const auto& bounds : rasters[v].chunkBounds) {
+            minX = std::min(minX, bounds[0]);
+            minY = std::min(minY, bounds[1]);
+            maxX = std::max(maxX, bounds[2]);
+            maxY = std::max(maxY, bounds[3]);
+        }
+
+        float spanX = std::max(0.001f, maxX - minX);
+        float spanY = std::max(0.001f, maxY - minY);
+        projections[v].scale = std::min((w - 2.0f * pad) / spanX, (h - 2.0f * pad) / spanY);
+        projections[v].cx = (minX + maxX) * 0.5f;
+        projections[v].cy = (minY + maxY) * 0.5f;
+
+        rasters[v].setups.resize(tris.size());
+        rasters[v].img.assign(static_cast<size_t>(w) * h * 4, 0);
+    }
+
+    // Project every vertex once; triangle setup reads the cached screen position.
+    forEachViewChunk(vertexChunks, [&](size_t v, size_t c) {
+        const Projection& proj = projections[v];
+        ViewRaster& view = rasters[v];
+        const float halfW = w * 0.5f;
+        const float halfH = h * 0.5f;
+        const float bottom = static_cast<float>(h - 1);
+        const size_t end = std::min(verts.size(), (c + 1) * kVertexChunk);
+        for (size_t i = c * kVertexChunk; i < end; ++i) {
+            view.sx[i] = (view.rotated.x[i] - proj.cx) * proj.scale + halfW;
+            view.sy[i] = bottom - ((view.rotated.z[i] - proj.cy) * proj.scale + halfH);
+        }
+    });
+
+    // Set up every triangle once; culled and degenerate ones get an empty box.
+    constexpr size_t kSetupChunk = 8192;
+    forEachViewChunk((tris.size() + kSetupChunk - 1) / kSetupChunk, [&](size_t v, size_t c) {
+        const ViewRaster& view = rasters[v];
+        const VertexStreams& rotated = view.rotated;
+        auto drawVertex = [&](uint32_t i) -> DrawVertex { return {view.sx[i], view.sy[i], -rotated.y[i]}; };
+        auto viewPosition = [&](uint32_t i) -> Vec3 { return {rotated.x[i], rotated.y[i], rotated.z[i]}; };
+
+        const size_t end = std::min(tris.size(), (c + 1) * kSetupChunk);
+        for (size_t t = c * kSetupChunk; t < end; ++t) {
+            const auto& tri = tris[t];
+            TriangleSetup& setup = rasters[v].setups[t];
+            const Vec3 p0 = viewPosition(tri[0]);
+            Vec3 faceN = Normalize(Cross(Sub(viewPosition(tri[1]), p0), Sub(viewPosition(tri[2]), p0)));
+            if (Dot(faceN, viewDir) <= 0.0f) {
+                continue;
+            }
+
+            setup.v0 = drawVertex(tri[0]);
+            setup.v1 = drawVertex(tri[1]);
+            setup.v2 = drawVertex(tri[2]);
+            const DrawVertex& v0 = setup.v0;
+            const DrawVertex& v1 = setup.v1;
+            const DrawVertex& v2 = setup.v2;
+
+            float denom = (v1.sy - v2.sy) * (v0.sx - v2.sx) + (v2.sx - v1.sx) * (v0.sy - v2.sy);
+            if (std::fabs(denom) < 1e-6f) continue;
+
+            float minPx = std::floor(std::min({v0.sx, v1.sx, v2.sx}));
+            float maxPx = std::ceil(std::max({v0.sx, v1.sx, v2.sx}));
+            float minPy = std::floor(std::min({v0.sy, v1.sy, v2.sy}));
+            float maxPy = std::ceil(std::max({v0.sy, v1.sy, v2.sy}));
+
+            setup.tri = static_cast<uint32_t>(t);
+            setup.denom = denom;
+            setup.x0 = static_cast<int>(std::clamp(minPx, 0.0f, static_cast<float>(w - 1)));
+            setup.x1 = static_cast<int>(std::clamp(maxPx, 0.0f, static_cast<float>(w - 1)));
+            setup.y0 = static_cast<int>(std::clamp(minPy, 0.0f, static_cast<float>(h - 1)));
+            setup.y1 = static_cast<int>(std::clamp(maxPy, 0.0f, static_cast<float>(h - 1)));
+            if (!SetupEdges(setup)) setup.x1 = setup.x0 - 1;
+        }
+    });
+
+    // Bin in triangle order so each tile draws its triangles in the same order
+    // as a single full-screen pass would.
+    const int tilesX = (w + kRasterTile - 1) / kRasterTile;
+    const int tilesY = (h + kRasterTile - 1) / kRasterTile;
+    const size_t tileCount = static_cast<size_t>(tilesX) * tilesY;
+    pool.ParallelFor(viewCount, [&](size_t v) {
+        std::vector<std::vector<uint32_t>>& bins = rasters[v].bins;
+        bins.assign(tileCount, {});
+        const std::vector<TriangleSetup>& setups = rasters[v].setups;
+        for (uint32_t t = 0; t < setups.size(); ++t) {
+            const TriangleSetup& setup = setups[t];
+            if (setup.x1 < setup.x0 || setup.y1 < setup.y0) continue;
+            for (int ty = setup.y0 / kRasterTile; ty <= setup.y1 / kRasterTile; ++ty) {
+                for (int tx = setup.x0 / kRasterTile; tx <= setup.x1 / kRasterTile; ++tx) {
+                    bins[static_cast<size_t>(ty) * tilesX + tx].push_back(t);
+                }
+            }
+        }
+    });
+
+    std::atomic<uint64_t> fragments{0};
+    forEachViewChunk(tileCount, [&](size_t v, size_t tile) {
+        const std::vector<uint32_t>& bin = rasters[v].bins[tile];
+        if (bin.empty()) return;
+        const std::vector<TriangleSetup>& setups = rasters[v].setups;
+        const std::vector<Vec3>& normals = modelNormals;
+        const Vec3 light = rasters[v].light;
+        std::vector<uint8_t>& img = rasters[v].img;
+        const int tileX0 = static_cast<int>(tile % tilesX) * kRasterTile;
+        const int tileY0 = static_cast<int>(tile / tilesX) * kRasterTile;
+        const int tileX1 = std::min(w, tileX0 + kRasterTile) - 1;
+        const int tileY1 = std::min(h, tileY0 + kRasterTile) - 1;
+        // Depth pass: resolve the nearest triangle per pixel, in triangle order.
+        thread_local TileDepth target;
+        target.Clear();
+        for (uint32_t t : bin) {
+            const TriangleSetup& setup = setups[t];
+            RasterizeDepth(setup, t, tileX0, tileY0, std::max(setup.x0, tileX0), std::min(setup.x1, tileX1),
+                           std::max(setup.y0, tileY0), std::min(setup.y1, tileY1), target);
+        }
+
+        // Shading pass: one lighting evaluation per visible pixel.
+        uint64_t shaded = 0;
+        for (int y = tileY0; y <= tileY1; ++y) {
+            for (int x = tileX0; x <= tileX1; ++x) {
+                const uint32_t t = target.tri[(y - tileY0) * TileDepth::kStride + (x - tileX0)];
+                if (t == kNoTriangle) continue;
+                shaded++;
+                const TriangleSetup& setup = setups[t];
+                const auto& tri = tris[setup.tri];
+                const Vec3& n0 = normals[tri[0]];
+                const Vec3& n1 = normals[tri[1]];
+                const Vec3& n2 = normals[tri[2]];
+
+                float w0 = 0.0f;
+                float w1 = 0.0f;
+                float w2 = 0.0f;
+                setup.Barycentrics(x, y, w0, w1, w2);
+                Vec3 n = Normalize({
+                    n0.x * w0 + n1.x * w1 + n2.x * w2,
+                    n0.y * w0 + n1.y * w1 + n2.y * w2,
+                    n0.z * w0 + n1.z * w1 + n2.z * w2
+                });
+
+                float shade = std::clamp(0.25f + 0.75f * std::max(0.0f, Dot(n, light)), 0.0f, 1.0f);
+                uint8_t baseR = 220;
+                uint8_t baseG = 200;
+                uint8_t baseB = 190;
+                uint8_t r = static_cast<uint8_t>(baseR * shade);
+                uint8_t g = static_cast<uint8_t>(baseG * shade);
+                uint8_t b = static_cast<uint8_t>(baseB * shade);
+
+                size_t pix = (static_cast<size_t>(y) * w + x) * 4;
+                img[pix + 0] = r;
+                img[pix + 1] = g;
+                img[pix + 2] = b;
+                img[pix + 3] = 255;
+            }
+        }
+        fragments += shaded;
+    });
+    gProfile.fragments += fragments;
+
+    outImages.resize(viewCount);
+    for (size_t v = 0; v < viewCount; ++v) {
+        outImages[v] = std::move(rasters[v].img);
+    }
+    return true;
+}
+
+struct FileStamp {
+    fs::path path;
+    fs::file_time_type mtime{};
+    uintmax_t size = 0;
+    bool exists = false;
+
+    bool operator==(const FileStamp& other) const {
+        return exists == other.exists && mtime == other.mtime && size == other.size;
+    }
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+static FileStamp StampFile(const fs::path& path) {
+    FileStamp stamp;
+    stamp.path = path;
+    std::error_code ec;
+    auto status = fs::status(path, ec);
+    if (ec || !fs::exists(status)) return stamp;
+    stamp.exists = true;
+    stamp.mtime = fs::last_write_time(path, ec);
+    if (fs::is_regular_file(status)) {
+        stamp.size = fs::file_size(path, ec);
+    }
+    return stamp;
+}
+
+struct LoadedBody {
+    SliderSet sliderSet;
+    std::vector<MeshShape> baseShapes;
+    VertexAdjacency adjacency; // of the concatenated base shapes
+    DiffDataSets diffData;
+
+    // Files whose change requires reloading the whole body (.osp, NIF and, for
+    // fallback resolutions, the SliderSets directory) and per-OSD stamps that
+    // only require reloading that file's diff sets.
+    std::vector<FileStamp> sources;
+    OsdRefs osdRefs;
+    std::vector<FileStamp> osdFiles;
+
+    // Paths OSD resolution looked at without using (missing expected files and
+    // searched ShapeData directories); a change means names may resolve anew.
+    std::vector<FileStamp> resolution;
+
+    // Diff sets that have been asked for so far. With allDiffs every
+    // referenced set is resident and nothing is loaded on demand.
+    std::vector<char> requestedDiffs; // by diff set ID
+    bool allDiffs = false;
+
+    // Set when the body was served from a morph pack; diff sets point into it.
+    std::shared_ptr<MappedFile> pack;
+};
+
+// Morph packs: one versioned file per slider set holding everything a render
+// needs, so warm runs skip XML, NIF and OSD parsing and morph straight from the
+// mapped pages.
+//
+//   header   magic 'BSMP', version, meta size (u64), data offset (u64)
+//   meta     source stamps, OSD resolution stamps, slider set, shapes
+//            (vertex/triangle offsets), diff sets (name, target, count, offset)
+//   data     32-byte aligned arrays: shape vertices (x,y,z floats), triangles
+//            (3 x u16), and per diff set indices, dx, dy, dz
+constexpr uint32_t kMorphPackMagic = 0x504D5342; // 'BSMP'
+constexpr uint32_t kMorphPackVersion = 2;
+constexpr size_t kMorphPackHeaderSize = 24;
+
+static fs::path MorphPackPath(const fs::path& packDir, const fs::path& sliderSetsDir, const std::string& setName) {
+    std::string key = sliderSetsDir.generic_u8string() + "\n" + setName;
+    return packDir / (HashHex(HashBytes(key.data(), key.size())) + ".bsmp");
+}
+
+static bool WriteMorphPack(const fs::path& file, const LoadedBody& body) {
+    ProfileScope profile(ProfileStage::PackWrite);
+    BinaryWriter meta;
+    BinaryWriter data;
+
+    std::vector<const FileStamp*> stamps;
+    for (const auto& stamp : body.sources) {
+        std::error_code ec;
+        if (fs::is_regular_file(stamp.path, ec)) stamps.push_back(&stamp);
+    }
+    for (const auto& stamp : body.osdFiles) stamps.push_back(&stamp);
+
+    auto putStamp = [&](const FileStamp& stamp) {
+        meta.PutString(stamp.path.generic_u8string());
+        meta.Put(FileTimeToInt(stamp.mtime));
+        meta.Put(static_cast<uint64_t>(stamp.size));
+        meta.Put(static_cast<uint8_t>(stamp.exists ? 1 : 0));
+    };
+    meta.Put(static_cast<uint32_t>(stamps.size()));
+    for (const FileStamp* stamp : stamps) putStamp(*stamp);
+    meta.Put(static_cast<uint32_t>(body.resolution.size()));
+    for (const auto& stamp : body.resolution) putStamp(stamp);
+
+    const SliderSet& set = body.sliderSet;
+    meta.PutString(set.name);
+    meta.PutString(set.dataFolder);
+    meta.PutString(set.sourceFile);
+    meta.PutString(set.ospFile.generic_u8string());
+    meta.Put(static_cast<uint32_t>(set.shapes.size()));
+    for (const auto& shape : set.shapes) {
+        meta.PutString(shape.first);
+        meta.PutString(shape.second);
+    }
+    meta.Put(static_cast<uint32_t>(set.sliders.size()));
+    for (const auto& slider : set.sliders) {
+        uint8_t flags = (slider.invert ? 1 : 0) | (slider.clamp ? 2 : 0) | (slider.zap ? 4 : 0) | (slider.uv ? 8 : 0);
+        meta.PutString(slider.name);
+        meta.Put(flags);
+        meta.Put(slider.defaultValue);
+        meta.Put(static_cast<uint32_t>(slider.dataFiles.size()));
+        for (const auto& ddf : slider.dataFiles) {
+            meta.PutString(ddf.dataName);
+            meta.PutString(ddf.targetName);
+            meta.PutString(ddf.fileName);
+            meta.Put(static_cast<uint8_t>(ddf.local ? 1 : 0));
+        }
+    }
+
+    meta.Put(static_cast<uint32_t>(body.baseShapes.size()));
+    for (const auto& shape : body.baseShapes) {
+        meta.PutString(shape.name);
+        meta.PutString(shape.targetName);
+
+        data.Align(DiffArena::kAlign);
+        meta.Put(static_cast<uint32_t>(shape.verts.size()));
+        meta.Put(static_cast<uint64_t>(data.Size()));
+        for (const auto& v : shape.verts) {
+            data.Put(v.x);
+            data.Put(v.y);
+            data.Put(v.z);
+        }
+
+        data.Align(DiffArena::kAlign);
+        meta.Put(static_cast<uint32_t>(shape.tris.size()));
+        meta.Put(static_cast<uint64_t>(data.Size()));
+        for (const auto& t : shape.tris) {
+            data.Put(t.p1);
+            data.Put(t.p2);
+            data.Put(t.p3);
+        }
+    }
+
+    std::map<std::string, std::pair<const std::string*, const TargetDataDiffs*>> sets;
+    body.diffData.ForEachSet([&](const std::string& name, const std::string& target, const TargetDataDiffs& diffs) {
+        sets.emplace(name, std::make_pair(&target, &diffs));
+    });
+    meta.Put(static_cast<uint32_t>(sets.size()));
+    for (const auto& named : sets) {
+        const TargetDataDiffs& diffs = *named.second.second;
+        meta.PutString(named.first);
+        meta.PutString(*named.second.first);
+
+        data.Align(DiffArena::kAlign);
+        meta.Put(diffs.count);
+        meta.Put(static_cast<uint64_t>(data.Size()));
+        data.PutBytes(diffs.indices, diffs.count * sizeof(uint16_t));
+        data.Align(DiffArena::kAlign);
+        data.PutBytes(diffs.dx, diffs.count * sizeof(float));
+        data.Align(DiffArena::kAlign);
+        data.PutBytes(diffs.dy, diffs.count * sizeof(float));
+        data.Align(DiffArena::kAlign);
+        data.PutBytes(diffs.dz, diffs.count * sizeof(float));
+    }
+    data.Align(DiffArena::kAlign);
+
+    BinaryWriter out;
+    uint64_t dataOffset = DiffArena::AlignUp(kMorphPackHeaderSize + meta.Size());
+    out.Put(kMorphPackMagic);
+    out.Put(kMorphPackVersion);
+    out.Put(static_cast<uint64_t>(meta.Size()));
+    out.Put(dataOffset);
+    out.PutBytes(meta.Data().data(), meta.Size());
+    out.Align(DiffArena::kAlign);
+    out.PutBytes(data.Data().data(), data.Size());
+    return out.Save(file);
+}
+
+// Maps a morph pack into outBody. Returns false if the pack is missing, invalid
+// or stale (outStale is set when one of its source files changed).
+static bool LoadMorphPack(const fs::path& file, LoadedBody& outBody, bool& outStale) {
+    ProfileScope profile(ProfileStage::PackLoad);
+    outStale = false;
+    auto mapped = std::make_shared<MappedFile>();
+    if (!mapped->Open(file) || mapped->Size() < kMorphPackHeaderSize) return false;
+
+    BinaryReader header(mapped->Data(), kMorphPackHeaderSize);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t metaSize = 0;
+    uint64_t dataOffset = 0;
+    header.Get(magic);
+    header.Get(version);
+    header.Get(metaSize);
+    header.Get(dataOffset);
+    if (magic != kMorphPackMagic || version != kMorphPackVersion) return false;
+    if (kMorphPackHeaderSize + metaSize > mapped->Size() || dataOffset > mapped->Size()) return false;
+
+    const uint8_t* dataBase = mapped->Data() + dataOffset;
+    const size_t dataSize = mapped->Size() - dataOffset;
+    auto inData = [&](uint64_t offset, size_t bytes) { return offset <= dataSize && bytes <= dataSize - offset; };
+
+    BinaryReader meta(mapped->Data() + kMorphPackHeaderSize, static_cast<size_t>(metaSize));
+    LoadedBody body;
+
+    for (auto* stamps : {&body.sources, &body.resolution}) {
+        uint32_t stampCount = 0;
+        meta.Get(stampCount);
+        for (uint32_t i = 0; i < stampCount && meta.Ok(); ++i) {
+            std::string path;
+            int64_t mtime = 0;
+            uint64_t size = 0;
+            uint8_t exists = 0;
+            meta.GetString(path);
+            meta.Get(mtime);
+            meta.Get(size);
+            meta.Get(exists);
+            FileStamp current = StampFile(fs::u8path(path));
+            if (current.exists != (exists != 0) || FileTimeToInt(current.mtime) != mtime || current.size != size) {
+                outStale = true;
+                return false;
+            }
+            stamps->push_back(std::move(current));
+        }
+    }
+
+    SliderSet& set = body.sliderSet;
+    std::string ospFile;
+    meta.GetString(set.name);
+    meta.GetString(set.dataFolder);
+    meta.GetString(set.sourceFile);
+    meta.GetString(ospFile);
+    set.ospFile = fs::u8path(ospFile);
+
+    uint32_t shapeCount = 0;
+    meta.Get(shapeCount);
+    for (uint32_t i = 0; i < shapeCount && meta.Ok(); ++i) {
+        std::pair<std::string, std::string> shape;
+        meta.GetString(shape.first);
+        meta.GetString(shape.second);
+        set.shapes.push_back(std::move(shape));
+    }
+
+    uint32_t sliderCount = 0;
+    meta.Get(sliderCount);
+    for (uint32_t i = 0; i < sliderCount && meta.Ok(); ++i) {
+        Slider slider;
+        uint8_t flags = 0;
+        uint32_t dataCount = 0;
+        meta.GetString(slider.name);
+        meta.Get(flags);
+        meta.Get(slider.defaultValue);
+        meta.Get(dataCount);
+        slider.invert = (flags & 1) != 0;
+        slider.clamp = (flags & 2) != 0;
+        slider.zap = (flags & 4) != 0;
+        slider.uv = (flags & 8) != 0;
+        for (uint32_t d = 0; d < dataCount && meta.Ok(); ++d) {
+            SliderDataFile ddf;
+            uint8_t local = 0;
+            meta.GetString(ddf.dataName);
+            meta.GetString(ddf.targetName);
+            meta.GetString(ddf.fileName);
+            meta.Get(local);
+            ddf.local = local != 0;
+            slider.dataFiles.push_back(std::move(ddf));
+        }
+        set.sliders.push_back(std::move(slider));
+    }
+
+    uint32_t meshCount = 0;
+    meta.Get(meshCount);
+    for (uint32_t i = 0; i < meshCount && meta.Ok(); ++i) {
+        MeshShape shape;
+        uint32_t vertCount = 0;
+        uint64_t vertOffset = 0;
+        uint32_t triCount = 0;
+        uint64_t triOffset = 0;
+        meta.GetString(shape.name);
+        meta.GetString(shape.targetName);
+        meta.Get(vertCount);
+        meta.Get(vertOffset);
+        meta.Get(triCount);
+        meta.Get(triOffset);
+        if (!meta.Ok() || !inData(vertOffset, vertCount * 3 * sizeof(float)) ||
+            !inData(triOffset, triCount * 3 * sizeof(uint16_t))) {
+            return false;
+        }
+
+        const float* verts = reinterpret_cast<const float*>(dataBase + vertOffset);
+        shape.verts.resize(vertCount);
+        for (uint32_t v = 0; v < vertCount; ++v) {
+            shape.verts[v].x = verts[v * 3 + 0];
+            shape.verts[v].y = verts[v * 3 + 1];
+            shape.verts[v].z = verts[v * 3 + 2];
+        }
+
+        const uint8_t* tris = dataBase + triOffset;
+        shape.tris.resize(triCount);
+        for (uint32_t t = 0; t < triCount; ++t) {
+            std::memcpy(&shape.tris[t].p1, tris + t * 6 + 0, sizeof(uint16_t));
+            std::memcpy(&shape.tris[t].p2, tris + t * 6 + 2, sizeof(uint16_t));
+            std::memcpy(&shape.tris[t].p3, tris + t * 6 + 4, sizeof(uint16_t));
+        }
+        body.baseShapes.push_back(std::move(shape));
+    }
+
+    uint32_t diffCount = 0;
+    meta.Get(diffCount);
+    for (uint32_t i = 0; i < diffCount && meta.Ok(); ++i) {
+        std::string name;
+        std::string target;
+        uint32_t count = 0;
+        uint64_t offset = 0;
+        meta.GetString(name);
+        meta.GetString(target);
+        meta.Get(count);
+        meta.Get(offset);
+        if (!meta.Ok() || offset % DiffArena::kAlign != 0 || !inData(offset, DiffArena::SetBytes(count))) return false;
+
+        TargetDataDiffs diffs;
+        diffs.count = count;
+        diffs.indices = reinterpret_cast<const uint16_t*>(dataBase + offset);
+        offset += DiffArena::AlignUp(count * sizeof(uint16_t));
+        diffs.dx = reinterpret_cast<const float*>(dataBase + offset);
+        offset += DiffArena::AlignUp(count * sizeof(float));
+        diffs.dy = reinterpret_cast<const float*>(dataBase + offset);
+        offset += DiffArena::AlignUp(count * sizeof(float));
+        diffs.dz = reinterpret_cast<const float*>(dataBase + offset);
+        diffs.owner = mapped;
+        body.diffData.MoveToSet(name, target, std::move(diffs));
+    }
+
+    if (!meta.Ok() || !meta.AtEnd()) return false;
+
+    body.pack = std::move(mapped);
+    body.allDiffs = true;
+    outBody = std::move(body);
+    return true;
+}
+
+
+struct BodyPaths {
+    fs::path presetsDir;
+    fs::path sliderSetsDir;
+    fs::path shapeDataRoot;
+};
+
+struct BodyLookups {
+    SliderSetCatalog* sliderSets = nullptr;
+    const ShapeDataIndex* shapeData = nullptr;
+    fs::path packDir; // empty when morph packs are disabled
+};
+
+// Catalog entry of a slider set with the "CBBE Body"/first set fallbacks, or
+// null when the catalog has no sets at all.
+static const SliderSetInfo* ResolveSliderSet(const SliderSetCatalog& catalog, const std::string& sliderSetName,
+                                             fs::path& outFile) {
+    const SliderSetInfo* info = catalog.Find(sliderSetName, outFile);
+    if (!info) info = catalog.Find("CBBE Body", outFile);
+    if (!info) info = catalog.First(outFile);
+    return info;
+}
+
+static void WarnSliderSetFallback(const std::string& requested, const std::string& resolved) {
+    std::cerr << "Warning: slider set not found: " << requested << "\n";
+    std::cerr << "Using fallback slider set: " << resolved << "\n";
+}
+
+// Resolves a slider set (with the "CBBE Body"/first set fallbacks) and loads its
+// base mesh and OSD data, from its morph pack when one is current. Returns 0 on
+// success or the process exit code to use.
+static int LoadBody(const BodyPaths& paths, const BodyLookups& lookups, const std::string& sliderSetName,
+                    bool verbose, LoadedBody& outBody) {
+    SliderSetCatalog* catalog = lookups.sliderSets;
+    SliderSet& sliderSet = outBody.sliderSet;
+    fs::path packFile;
+
+    if (catalog) {
+        fs::path ospFile;
+        const SliderSetInfo* info = ResolveSliderSet(*catalog, sliderSetName, ospFile);
+        if (!info) {
+            std::cerr << "Warning: slider set not found: " << sliderSetName << "\n";
+            std::cerr << "No slider sets found; aborting.\n";
+            return 3;
+        }
+        if (info->name != sliderSetName) WarnSliderSetFallback(sliderSetName, info->name);
+
+        if (!lookups.packDir.empty()) {
+            packFile = MorphPackPath(lookups.packDir, paths.sliderSetsDir, info->name);
+            bool stale = false;
+            if (LoadMorphPack(packFile, outBody, stale)) {
+                gProfile.morphPacks.hits++;
+                InternMorphSymbols(sliderSet, outBody.baseShapes, outBody.diffData);
+                if (info->name != sliderSetName) {
+                    outBody.sources.push_back(StampFile(paths.sliderSetsDir));
+                }
+                std::cout << "Slider set: " << sliderSet.name << " (morph pack)\n";
+                std::cout << "Shapes: " << sliderSet.shapes.size() << ", sliders: " << sliderSet.sliders.size()
+                          << ", diff sets: " << outBody.diffData.Size() << "\n";
+                return 0;
+            }
+            gProfile.morphPacks.misses++;
+            if (stale) {
+                std::cout << "Morph pack out of date, rebuilding: " << info->name << "\n";
+            }
+        }
+
+        if (!SliderSetCatalog::Materialize(ospFile, *info, sliderSet)) {
+            // The file changed under its catalog entry; rescan it and read the
+            // set the slow way once before giving up.
+            const std::string setName = info->name;
+            if (verbose) std::cerr << "Slider set catalog out of date, rereading: " << ospFile.string() << "\n";
+            catalog->Invalidate(ospFile);
+            if (!FindSliderSetFile(paths.sliderSetsDir, setName, sliderSet)) {
+                std::cerr << "Failed to read slider set " << setName << " from " << ospFile.string() << "\n";
+                return 3;
+            }
+        }
+    } else if (!FindSliderSetFile(paths.sliderSetsDir, sliderSetName, sliderSet)) {
+        std::cerr << "Warning: slider set not found: " << sliderSetName << "\n";
+        if (!FindSliderSetFile(paths.sliderSetsDir, "CBBE Body", sliderSet)) {
+            if (!LoadFirstSliderSet(paths.sliderSetsDir, sliderSet)) {
+                std::cerr << "No slider sets found; aborting.\n";
+                return 3;
+            }
+        }
+        std::cerr << "Using fallback slider set: " << sliderSet.name << "\n";
+    }
+
+    std::cout << "Slider set: " << sliderSet.name << "\n";
+    std::cout << "Data folder: " << sliderSet.dataFolder << "\n";
+    std::cout << "Source NIF: " << sliderSet.sourceFile << "\n";
+    std::cout << "Shapes: " << sliderSet.shapes.size() << ", sliders: " << sliderSet.sliders.size() << "\n";
+
+    fs::path nifPath = paths.shapeDataRoot / sliderSet.dataFolder / sliderSet.sourceFile;
+    if (!fs::exists(nifPath)) {
+        std::cerr << "NIF not found: " << nifPath.string() << "\n";
+        return 4;
+    }
+
+    if (!LoadMeshShapes(nifPath, sliderSet, outBody.baseShapes)) {
+        std::cerr << "Failed to load base mesh from NIF.\n";
+        return 5;
+    }
+    InternMorphSymbols(sliderSet, outBody.baseShapes, outBody.diffData);
+
+    std::vector<fs::path> probed;
+    outBody.osdRefs = ResolveOsdRefs(sliderSet, paths.shapeDataRoot, verbose, lookups.shapeData, &probed);
+    for (const auto& path : probed) outBody.resolution.push_back(StampFile(path));
+    if (!packFile.empty()) {
+        // The pack has to hold every set; later runs map it instead of decoding.
+        outBody.diffData.LoadData(outBody.osdRefs);
+        outBody.allDiffs = true;
+    }
+
+    outBody.sources.push_back(StampFile(sliderSet.ospFile));
+    outBody.sources.push_back(StampFile(nifPath));
+    if (sliderSet.name != sliderSetName) {
+        outBody.sources.push_back(StampFile(paths.sliderSetsDir));
+    }
+    for (const auto& osd : outBody.osdRefs) {
+        outBody.osdFiles.push_back(StampFile(osd.first));
+    }
+
+    if (!packFile.empty()) {
+        if (WriteMorphPack(packFile, outBody)) {
+            if (verbose) std::cerr << "Wrote morph pack: " << packFile.string() << "\n";
+        } else {
+            std::cerr << "Warning: failed to write morph pack: " << packFile.string() << "\n";
+        }
+    }
+    return 0;
+}
+
+// Makes the named diff sets resident, reading only the OSD files and blocks
+// that hold sets not asked for before.
+static void LoadDiffSets(LoadedBody& body, const std::vector<uint32_t>& ids) {
+    if (body.allDiffs) return;
+    body.requestedDiffs.resize(body.diffData.setNames.Size(), 0);
+    std::unordered_set<std::string> names;
+    for (uint32_t id : ids) {
+        if (body.requestedDiffs[id]) continue;
+        body.requestedDiffs[id] = 1;
+        names.insert(body.diffData.setNames.Name(id));
+    }
+
+    if (!names.empty()) {
+        OsdRefs pending;
+        for (const auto& osd : body.osdRefs) {
+            for (const auto& data : osd.second) {
+                if (names.count(data.first)) pending[osd.first].insert(data);
+            }
+        }
+        body.diffData.LoadData(pending);
+    }
+
+    if (gVerbose) {
+        std::cerr << "Diff sets resident: " << body.diffData.Size() << " (" << ids.size() << " needed by preset)\n";
+    }
+}
+
+// Loaded bodies keyed by requested slider set name. Several names can resolve to
+// the same body through the fallbacks, so bodies are owned separately by their
+// resolved name.
+struct BodyCache {
+    std::unordered_map<std::string, std::unique_ptr<LoadedBody>> byResolvedName;
+    std::unordered_map<std::string, LoadedBody*> byRequestedName;
+    std::unordered_map<std::string, int> failed; // requested name -> exit code of the failed load
+
+    LoadedBody* Find(const std::string& sliderSetName) const {
+        auto it = byRequestedName.find(sliderSetName);
+        return it == byRequestedName.end() ? nullptr : it->second;
+    }
+
+    // Makes a requested name an alias of an already loaded body.
+    LoadedBody* Alias(const std::string& sliderSetName, const std::string& resolvedName) {
+        auto it = byResolvedName.find(resolvedName);
+        if (it == byResolvedName.end()) return nullptr;
+        byRequestedName[sliderSetName] = it->second.get();
+        return it->second.get();
+    }
+
+    LoadedBody* Insert(const std::string& sliderSetName, std::unique_ptr<LoadedBody> body) {
+        auto& slot = byResolvedName[body->sliderSet.name];
+        if (!slot) slot = std::move(body);
+        byRequestedName[sliderSetName] = slot.get();
+        return slot.get();
+    }
+
+    void Clear() {
+        byRequestedName.clear();
+        byResolvedName.clear();
+        failed.clear();
+    }
+
+    // Checks every resident body against the files it was built from. Bodies whose
+    // .osp or NIF changed are dropped and reloaded on next use; changed OSD files
+    // only have their own diff sets reloaded in place.
+    void Refresh(bool verbose) {
+        // Files may have been fixed since; failed loads are tried again.
+        failed.clear();
+        for (auto it = byResolvedName.begin(); it != byResolvedName.end();) {
+            LoadedBody* body = it->second.get();
+
+            bool stale = false;
+            for (const auto* stamps : {&body->sources, &body->resolution}) {
+                for (const auto& source : *stamps) {
+                    if (StampFile(source.path) != source) {
+                        stale = true;
+                        break;
+                    }
+                }
+            }
+
+            if (stale) {
+                std::cerr << "Slider set changed on disk, unloading: " << it->first << "\n";
+                for (auto req = byRequestedName.begin(); req != byRequestedName.end();) {
+                    if (req->second == body) {
+                        req = byRequestedName.erase(req);
+                    } else {
+                        ++req;
+                    }
+                }
+                it = byResolvedName.erase(it);
+                continue;
+            }
+
+            for (auto& osdStamp : body->osdFiles) {
+                FileStamp current = StampFile(osdStamp.path);
+                if (current == osdStamp) continue;
+
+                auto refs = body->osdRefs.find(osdStamp.path.string());
+                if (refs != body->osdRefs.end()) {
+                    OsdRefs changed;
+                    OsdDataNames& reload = changed[refs->first];
+                    for (const auto& dataName : refs->second) {
+                        body->diffData.Remove(dataName.first);
+                        const uint32_t id = body->diffData.setNames.Find(dataName.first);
+                        const bool requested = id < body->requestedDiffs.size() && body->requestedDiffs[id];
+                        if (body->allDiffs || requested) reload.insert(dataName);
+                    }
+                    body->diffData.LoadData(changed);
+                }
+                if (verbose) {
+                    std::cerr << "Reloaded OSD: " << osdStamp.path.string() << "\n";
+                }
+                osdStamp = current;
+            }
+
+            ++it;
+        }
+    }
+};
+
+// Concatenates the shapes into one vertex and triangle list, one task per
+// shape writing at its precomputed offset. outVertOffsets receives each
+// shape's first vertex.
+void ConcatenateShapes(const std::vector<MeshShape>& shapes, std::vector<Vec3>& outVerts,
+                       std::vector<std::array<uint32_t, 3>>& outTris,
+                       std::vector<uint32_t>* outVertOffsets) {
+    std::vector<uint32_t> vertOffsets(shapes.size());
+    std::vector<size_t> triOffsets(shapes.size());
+    size_t vertCount = 0;
+    size_t triCount = 0;
+    for (size_t s = 0; s < shapes.size(); ++s) {
+        vertOffsets[s] = static_cast<uint32_t>(vertCount);
+        triOffsets[s] = triCount;
+        vertCount += shapes[s].verts.size();
+        triCount += shapes[s].tris.size();
+    }
+
+    outVerts.resize(vertCount);
+    outTris.resize(triCount);
+    WorkerPool().ParallelFor(shapes.size(), [&](size_t s) {
+        const uint32_t vertOffset = vertOffsets[s];
+        Vec3* verts = outVerts.data() + vertOffset;
+        for (const auto& v : shapes[s].verts) {
+            *verts++ = {v.x, v.y, v.z};
+        }
+        std::array<uint32_t, 3>* tris = outTris.data() + triOffsets[s];
+        for (const auto& t : shapes[s].tris) {
+            *tris++ = {vertOffset + t.p1, vertOffset + t.p2, vertOffset + t.p3};
+        }
+    });
+    if (outVertOffsets) *outVertOffsets = std::move(vertOffsets);
+}
+
+// Output path of view `index` when views are written as separate images:
+// "<stem>_<index><ext>", zero-padded to the width of the largest index.
+static std::string ViewImagePath(const std::string& outPath, size_t index, size_t count) {
+    fs::path path(outPath);
+    std::string number = std::to_string(index);
+    const size_t width = std::to_string(count - 1).size();
+    if (number.size() < width) number.insert(0, width - number.size(), '0');
+    return (path.parent_path() / (path.stem().string() + "_" + number + path.extension().string())).string();
+}
+
+static bool WriteViewImages(const std::string& outPath, const Args& args, const std::vector<std::vector<uint8_t>>& images) {
+    const int size = args.size;
+    const size_t stride = static_cast<size_t>(size) * 4;
+    if (images.size() == 1 && args.viewSpec.empty()) {
+        return WriteImage(outPath, args, images[0].data(), size, size);
+    }
+
+    if (!args.sheet) {
+        // PNG pieces already spread over the pool; QOI is serial per image, so
+        // its views are encoded side by side instead.
+        std::vector<uint8_t> written(images.size(), 0);
+        auto writeView = [&](size_t v) {
+            written[v] = WriteImage(ViewImagePath(outPath, v, images.size()), args, images[v].data(), size, size);
+        };
+        if (OutputImageFormat(outPath, args.imageFormat) == ImageFormat::Qoi) {
+            WorkerPool().ParallelFor(images.size(), writeView);
+        } else {
+            for (size_t v = 0; v < images.size(); ++v) writeView(v);
+        }
+        for (size_t v = 0; v < images.size(); ++v) {
+            if (!written[v]) return false;
+            std::cout << "View " << v << ": " << ViewImagePath(outPath, v, images.size()) << "\n";
+        }
+        return true;
+    }
+
+    // Sprite sheet: views left to right, top to bottom.
+    size_t columns = 0;
+    size_t rows = 0;
+    SheetGrid(args, images.size(), columns, rows);
+    const size_t sheetStride = stride * columns;
+    std::vector<uint8_t> sheet(sheetStride * size * rows, 0);
+    WorkerPool().ParallelFor(images.size(), [&](size_t v) {
+        uint8_t* origin = sheet.data() + (v / columns) * sheetStride * size + (v % columns) * stride;
+        for (int y = 0; y < size; ++y) {
+            std::memcpy(origin + y * sheetStride, images[v].data() + y * stride, stride);
+        }
+    });
+    std::cout << "Sprite sheet: " << columns << "x" << rows << " views of " << size << "px\n";
+    return WriteImage(outPath, args, sheet.data(), static_cast<int>(columns) * size, static_cast<int>(rows) * size);
+}
+
+static int RenderPreset(const Args& args, const RenderJob& job, const SliderValues& values, const LoadedBody& body) {
+    const SliderSet& sliderSet = body.sliderSet;
+    const DiffDataSets& diffData = body.diffData;
+    std::vector<MeshShape> shapes = body.baseShapes;
+
+    bool sawZap = false;
+    size_t nonZeroSliders = 0;
+    for (size_t k = 0; k < sliderSet.sliders.size(); ++k) {
+        const Slider& slider = sliderSet.sliders[k];
+        float val = values[k];
+        if (val != 0.0f) nonZeroSliders++;
+        if (slider.invert) val = 1.0f - val;
+        if (slider.zap && val > 0.0f && !shapes.empty()) sawZap = true;
+    }
+
+    std::vector<Vec3> allVerts;
+    std::vector<std::array<uint32_t, 3>> allTris;
+    {
+        ProfileScope profile(ProfileStage::Morph);
+        MorphShapes(values, sliderSet, diffData, args.verbose, shapes);
+        ConcatenateShapes(shapes, allVerts, allTris);
+    }
+
+    std::cout << "Non-zero sliders applied: " << nonZeroSliders << "\n";
+
+    if (sawZap) {
+        std::cerr << "Warning: zap sliders detected; zaps are currently ignored in this renderer.\n";
+    }
+
+    std::vector<ViewAngles> views;
+    if (!ParseViewSpec(args.viewSpec, {args.yawDeg, args.pitchDeg, args.rollDeg}, views)) {
+        std::cerr << "Invalid --views spec: " << args.viewSpec << "\n";
+        return 1;
+    }
+    if (args.sheet && !SheetFits(args, views.size())) {
+        std::cerr << "Sprite sheet too large: " << views.size() << " views of " << args.size << "px exceed "
+                  << kMaxSheetPixels << " pixels\n";
+        return 1;
+    }
+
+    gProfile.views += views.size();
+    gProfile.vertices += allVerts.size();
+    gProfile.triangles += allTris.size();
+    gProfile.activeSliders += nonZeroSliders;
+
+    // Normals are computed once in model space; every view and the GLB share them.
+    std::vector<Vec3> allNormals;
+    {
+        ProfileScope profile(ProfileStage::Normals);
+        allNormals = ComputeVertexNormals(allVerts, allTris, &body.adjacency);
+    }
+    std::vector<std::vector<uint8_t>> images;
+    bool rendered = false;
+    {
+        ProfileScope profile(ProfileStage::Raster);
+        rendered = RenderViews(allVerts, allNormals, allTris, args.size, views, images);
+    }
+    if (rendered) {
+        ProfileScope profile(ProfileStage::Encode);
+        rendered = WriteViewImages(job.outPath, args, images);
+    }
+    if (!rendered) {
+        std::cerr << "Failed to render image.\n";
+        return 6;
+    }
+
+    if (!job.exportGlbPath.empty()) {
+        ProfileScope profile(ProfileStage::GlbWrite);
+        std::vector<Vec3> exportVerts = allVerts;
+        std::vector<Vec3> exportNormals = std::move(allNormals);
+
+        if (args.exportYUp) {
+            for (auto& v : exportVerts) {
+                v = ConvertToYUp(v);
+            }
+            for (auto& n : exportNormals) {
+                n = Normalize(ConvertToYUp(n));
+            }
+        }
+
+        if (!ExportGlb(job.exportGlbPath, exportVerts, allTris, exportNormals, args.exportCompact)) {
+            std::cerr << "Failed to export GLB.\n";
+            return 7;
+        }
+        std::cout << "Exported GLB: " << job.exportGlbPath << "\n";
+    }
+
+    if (args.viewSpec.empty() || args.sheet) {
+        std::cout << "Rendered: " << job.outPath << "\n";
+    } else {
+        std::cout << "Rendered " << views.size() << " views\n";
+    }
+    return 0;
+}
+
+// Content hashes of source files, remembered per path with the mtime and size
+// they were computed for, so unchanged files are not read again.
+class ContentHashCache {
+public:
+    void Open(const fs::path& cacheFile) {
+        cacheFile_ = cacheFile;
+        if (!cacheFile_.empty()) Load();
+    }
+
+    // Hash of a regular file's bytes; directories and missing files hash their
+    // stamp instead.
+    uint64_t Hash(const FileStamp& stamp) {
+        const std::string key = stamp.path.generic_u8string();
+        const int64_t mtime = FileTimeToInt(stamp.mtime);
+        std::error_code ec;
+        if (!stamp.exists || !fs::is_regular_file(stamp.path, ec)) {
+            uint64_t hash = HashBytes(key.data(), key.size());
+            hash = HashBytes(&stamp.exists, sizeof(stamp.exists), hash);
+            return HashBytes(&mtime, sizeof(mtime), hash);
+        }
+
+        auto it = entries_.find(key);
+        if (it != entries_.end() && it->second.mtime == mtime && it->second.size == stamp.size) {
+            gProfile.contentHashes.hits++;
+            return it->second.hash;
+        }
+        gProfile.contentHashes.misses++;
+
+        uint64_t hash = HashBytes(nullptr, 0);
+        MappedFile file;
+        if (stamp.size > 0 && file.Open(stamp.path)) {
+            hash = HashBytes(file.Data(), file.Size());
+        }
+        entries_[key] = {mtime, static_cast<uint64_t>(stamp.size), hash};
+        dirty_ = true;
+        return hash;
+    }
+
+    void Flush() {
+        if (!dirty_ || cacheFile_.empty()) return;
+        if (!Save() && gVerbose) {
+            std::cerr << "Failed to write content hash cache: " << cacheFile_.string() << "\n";
+        }
+        dirty_ = false;
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x48435342; // 'BSCH'
+    static constexpr uint32_t kVersion = 1;
+
+    struct Entry {
+        int64_t mtime = 0;
+        uint64_t size = 0;
+        uint64_t hash = 0;
+    };
+
+    void Load() {
+        std::string data;
+        if (!ReadFileBytes(cacheFile_, data)) return;
+
+        BinaryReader reader(data);
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        uint32_t count = 0;
+        reader.Get(magic);
+        reader.Get(version);
+        reader.Get(count);
+        if (!reader.Ok() || magic != kMagic || version != kVersion) return;
+
+        std::unordered_map<std::string, Entry> entries;
+        for (uint32_t i = 0; i < count && reader.Ok(); ++i) {
+            std::string path;
+            Entry entry;
+            reader.GetString(path);
+            reader.Get(entry.mtime);
+            reader.Get(entry.size);
+            reader.Get(entry.hash);
+            entries.emplace(std::move(path), entry);
+        }
+        if (reader.Ok() && reader.AtEnd()) entries_ = std::move(entries);
+    }
+
+    bool Save() const {
+        BinaryWriter writer;
+        writer.Put(kMagic);
+        writer.Put(kVersion);
+        writer.Put(static_cast<uint32_t>(entries_.size()));
+        for (const auto& entry : entries_) {
+            writer.PutString(entry.first);
+            writer.Put(entry.second.mtime);
+            writer.Put(entry.second.size);
+            writer.Put(entry.second.hash);
+        }
+        return writer.Save(cacheFile_);
+    }
+
+    fs::path cacheFile_;
+    std::unordered_map<std::string, Entry> entries_;
+    bool dirty_ = false;
+};
+
+// State shared by every job of one process: resolved data paths, the cache
+// directory and everything loaded so far.
+struct Session {
+    BodyPaths paths;
+    fs::path cacheDir; // empty when caching is disabled
+    bool cacheDirRequested = false; // --cache-dir given rather than the temp default
+    bool useIndexes = false;
+    BodyCache bodies;
+    PresetIndex presetIndex;
+    bool presetIndexOpen = false;
+    bool presetIndexFresh = false;
+    SliderSetCatalog sliderSetCatalog;
+    bool sliderSetCatalogOpen = false;
+    bool sliderSetCatalogFresh = false;
+    ShapeDataIndex shapeDataIndex;
+    bool shapeDataIndexOpen = false;
+    bool shapeDataIndexFresh = false;
+    ContentHashCache contentHashes;
+    bool contentHashesOpen = false;
+    bool renderCache = false; // --render-cache and --cache-dir
+    size_t renderCacheHits = 0;
+    size_t renderCacheMisses = 0;
+
+    fs::path CacheFile(const std::string& kind, const fs::path& root, const char* ext) const {
+        if (cacheDir.empty()) return {};
+        std::string key = root.generic_u8string();
+        return cacheDir / (kind + "-" + HashHex(HashBytes(key.data(), key.size())) + ext);
+    }
+
+    // Marks on-disk indexes as needing revalidation before their next use.
+    void MarkStale() {
+        presetIndexFresh = false;
+        sliderSetCatalogFresh = false;
+        shapeDataIndexFresh = false;
+    }
+
+    ContentHashCache& GetContentHashes() {
+        if (!contentHashesOpen) {
+            contentHashes.Open(cacheDir.empty() ? fs::path() : cacheDir / "content-hashes.bin");
+            contentHashesOpen = true;
+        }
+        return contentHashes;
+    }
+
+    PresetIndex* GetPresetIndex() {
+        if (!useIndexes) return nullptr;
+        if (!presetIndexOpen) {
+            presetIndex.Open(paths.presetsDir, CacheFile("presets", paths.presetsDir, ".idx"));
+            presetIndexOpen = true;
+        } else if (!presetIndexFresh) {
+            presetIndex.Revalidate();
+        }
+        presetIndexFresh = true;
+        return &presetIndex;
+    }
+
+    SliderSetCatalog* GetSliderSetCatalog() {
+        if (!useIndexes) return nullptr;
+        if (!sliderSetCatalogOpen) {
+            sliderSetCatalog.Open(paths.sliderSetsDir, CacheFile("slidersets", paths.sliderSetsDir, ".idx"));
+            sliderSetCatalogOpen = true;
+        } else if (!sliderSetCatalogFresh) {
+            sliderSetCatalog.Revalidate();
+        }
+        sliderSetCatalogFresh = true;
+        return &sliderSetCatalog;
+    }
+
+    const ShapeDataIndex* GetShapeDataIndex() {
+        if (!useIndexes) return nullptr;
+        if (!shapeDataIndexOpen) {
+            shapeDataIndex.Open(paths.shapeDataRoot, CacheFile("shapedata", paths.shapeDataRoot, ".idx"));
+            shapeDataIndexOpen = true;
+        } else if (!shapeDataIndexFresh) {
+            shapeDataIndex.Revalidate();
+        }
+        shapeDataIndexFresh = true;
+        return &shapeDataIndex;
+    }
+
+    int GetBody(const std::string& sliderSetName, bool verbose, LoadedBody*& outBody) {
+        outBody = bodies.Find(sliderSetName);
+        if (outBody) {
+            gProfile.bodies.hits++;
+            std::cout << "Slider set: " << outBody->sliderSet.name << " (cached)\n";
+            return 0;
+        }
+        auto failure = bodies.failed.find(sliderSetName);
+        if (failure != bodies.failed.end()) {
+            std::cerr << "Slider set failed to load earlier: " << sliderSetName << "\n";
+            return failure->second;
+        }
+
+        // Covers the catalog and index loads; the NIF, OSD and pack work inside
+        // is timed as its own stages.
+        ProfileScope profile(ProfileStage::SliderSetLookup);
+        BodyLookups lookups;
+        lookups.sliderSets = GetSliderSetCatalog();
+        lookups.shapeData = GetShapeDataIndex();
+        if (cacheDirRequested) lookups.packDir = cacheDir / "packs";
+
+        // Names that fall back to a set already loaded share its body.
+        if (lookups.sliderSets) {
+            fs::path ospFile;
+            const SliderSetInfo* info = ResolveSliderSet(*lookups.sliderSets, sliderSetName, ospFile);
+            if (info && (outBody = bodies.Alias(sliderSetName, info->name)) != nullptr) {
+                gProfile.bodies.hits++;
+                if (info->name != sliderSetName) WarnSliderSetFallback(sliderSetName, info->name);
+                std::cout << "Slider set: " << outBody->sliderSet.name << " (cached)\n";
+                return 0;
+            }
+        }
+        gProfile.bodies.misses++;
+
+        auto body = std::make_unique<LoadedBody>();
+        int rc = LoadBody(paths, lookups, sliderSetName, verbose, *body);
+        if (rc != 0) {
+            bodies.failed[sliderSetName] = rc;
+            return rc;
+        }
+        {
+            ProfileScope normals(ProfileStage::Normals);
+            std::vector<Vec3> verts;
+            std::vector<std::array<uint32_t, 3>> tris;
+            ConcatenateShapes(body->baseShapes, verts, tris);
+            body->adjacency = BuildVertexAdjacency(verts.size(), tris);
+        }
+        outBody = bodies.Insert(sliderSetName, std::move(body));
+        return 0;
+    }
+};
+
+// Bump when a change to morphing, rendering or encoding alters output bytes.
+constexpr uint32_t kRenderCacheVersion = 1;
+
+// Every file one render job writes, in a fixed order: the image or views, each
+// followed by its mip levels, then the GLB.
+static std::vector<std::string> RenderOutputs(const Args& args, const RenderJob& job, size_t viewCount) {
+    std::vector<std::string> outputs;
+    auto addImage = [&](const std::string& path, int w, int h) {
+        outputs.push_back(path);
+        for (int mip = 1; mip <= args.mipLevels && w >= 2 && h >= 2; ++mip) {
+            w /= 2;
+            h /= 2;
+            outputs.push_back(MipImagePath(path, w));
+        }
+    };
+
+    if (viewCount == 1 && args.viewSpec.empty()) {
+        addImage(job.outPath, args.size, args.size);
+    } else if (!args.sheet) {
+        for (size_t v = 0; v < viewCount; ++v) addImage(ViewImagePath(job.outPath, v, viewCount), args.size, args.size);
+    } else {
+        size_t columns = 0;
+        size_t rows = 0;
+        SheetGrid(args, viewCount, columns, rows);
+        addImage(job.outPath, static_cast<int>(columns) * args.size, static_cast<int>(rows) * args.size);
+    }
+    if (!job.exportGlbPath.empty()) outputs.push_back(job.exportGlbPath);
+    return outputs;
+}
+
+// Content address of a render: everything that decides the output bytes and
+// nothing that does not. Presets enter only through their effective slider
+// weights, so renamed, duplicated or cosmetically edited presets share an
+// entry; the slider set enters through the content of its source files.
+static std::string RenderCacheKey(const Args& args, const RenderJob& job, const SliderValues& values,
+                                  const LoadedBody& body, const std::vector<ViewAngles>& views,
+                                  ContentHashCache& hashes) {
+    uint64_t hash = HashBytes(&kRenderCacheVersion, sizeof(kRenderCacheVersion));
+    auto mix = [&](const auto& value) { hash = HashBytes(&value, sizeof(value), hash); };
+    auto mixString = [&](const std::string& value) {
+        mix(static_cast<uint64_t>(value.size()));
+        hash = HashBytes(value.data(), value.size(), hash);
+    };
+
+    mixString(body.sliderSet.name);
+    for (const auto* stamps : {&body.sources, &body.osdFiles}) {
+        for (const auto& stamp : *stamps) {
+            mixString(stamp.path.generic_u8string());
+            mix(hashes.Hash(stamp));
+        }
+    }
+    mix(static_cast<uint64_t>(body.sliderSet.sliders.size()));
+    for (size_t k = 0; k < body.sliderSet.sliders.size(); ++k) {
+        const Slider& slider = body.sliderSet.sliders[k];
+        mixString(slider.name);
+        const float weight = SliderWeight(slider, values[k]);
+        mix(weight == 0.0f ? 0.0f : weight);
+    }
+
+    mix(args.size);
+    mix(static_cast<uint64_t>(views.size()));
+    for (const auto& view : views) {
+        mix(view.yawDeg);
+        mix(view.pitchDeg);
+        mix(view.rollDeg);
+    }
+    mix(args.viewSpec.empty());
+    mix(args.sheet);
+    if (args.sheet) mix(args.sheetColumns);
+    const ImageFormat format = OutputImageFormat(job.outPath, args.imageFormat);
+    mix(format);
+    if (format == ImageFormat::Png) mix(args.pngLevel);
+    mix(args.mipLevels);
+    mix(!job.exportGlbPath.empty());
+    if (!job.exportGlbPath.empty()) {
+        mix(args.exportYUp);
+        mix(args.exportCompact);
+    }
+    return HashHex(hash);
+}
+
+// Copies a cached render to the job's output paths. Returns false on a miss.
+static bool RestoreCachedRender(const fs::path& entryDir, const std::vector<std::string>& outputs) {
+    std::error_code ec;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        if (!fs::is_regular_file(entryDir / std::to_string(i), ec)) return false;
+    }
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        fs::copy_file(entryDir / std::to_string(i), outputs[i], fs::copy_options::overwrite_existing, ec);
+        if (ec) return false;
+    }
+    return true;
+}
+
+// Stores a finished render under its key. The entry is assembled in a
+// temporary directory and renamed into place, so readers never see a partial
+// entry; if another process stored the same key first, its copy is kept.
+static void StoreCachedRender(const fs::path& entryDir, const std::vector<std::string>& outputs) {
+    std::error_code ec;
+    fs::path tmp = entryDir;
+    tmp += ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    fs::create_directories(tmp, ec);
+    for (size_t i = 0; i < outputs.size() && !ec; ++i) {
+        fs::copy_file(outputs[i], tmp / std::to_string(i), fs::copy_options::overwrite_existing, ec);
+    }
+    if (!ec) fs::rename(tmp, entryDir, ec);
+    if (ec) {
+        fs::remove_all(tmp, ec);
+        if (gVerbose) std::cerr << "Render cache: could not store " << entryDir.string() << "\n";
+    }
+}
+
+static int RunJob(const Args& args, Session& session, const RenderJob& job) {
+    const BodyPaths& paths = session.paths;
+    gProfile.jobs++;
+    Preset preset;
+    bool found = false;
+    {
+        ProfileScope profile(ProfileStage::PresetLookup);
+        PresetIndex* presetIndex = job.presetFile.empty() ? session.GetPresetIndex() : nullptr;
+        found = FindPreset(paths.presetsDir, job.presetName, job.presetFile, presetIndex, preset);
+    }
+    if (!found) {
+        std::cerr << "Preset not found: " << job.presetName << "\n";
+        return 2;
+    }
+
+    std::cout << "Preset: " << preset.name << "\n";
+
+    std::string sliderSetName = args.sliderSetName.empty() ? preset.setName : args.sliderSetName;
+    LoadedBody* body = nullptr;
+    int rc = session.GetBody(sliderSetName, args.verbose, body);
+    if (rc != 0) return rc;
+    const SliderValues values = ResolvePresetValues(preset, body->sliderSet);
+
+    fs::path cacheEntry;
+    std::vector<std::string> outputs;
+    std::vector<ViewAngles> views;
+    if (session.renderCache && ParseViewSpec(args.viewSpec, {args.yawDeg, args.pitchDeg, args.rollDeg}, views)) {
+        ProfileScope profile(ProfileStage::RenderCache);
+        ContentHashCache& hashes = session.GetContentHashes();
+        const std::string key = RenderCacheKey(args, job, values, *body, views, hashes);
+        hashes.Flush();
+        outputs = RenderOutputs(args, job, views.size());
+        cacheEntry = session.cacheDir / "renders" / key;
+        if (RestoreCachedRender(cacheEntry, outputs)) {
+            session.renderCacheHits++;
+            std::cout << "Render cache: hit " << key << "\n";
+            return 0;
+        }
+        session.renderCacheMisses++;
+        std::cout << "Render cache: miss " << key << "\n";
+    }
+
+    LoadDiffSets(*body, CollectPresetDiffSets(values, body->sliderSet));
+
+    if (args.memoryReport) {
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t hashMapBytes = 0;
+        body->diffData.MemoryUsage(entries, bytes, hashMapBytes);
+        std::cout << std::fixed << std::setprecision(1)
+                  << "Diff memory: " << entries << " entries in " << body->diffData.Size() << " sets, "
+                  << (bytes / 1024.0) << " KiB sorted arrays (hash map layout: ~" << (hashMapBytes / 1024.0) << " KiB)\n"
+                  << std::defaultfloat;
+    }
+
+    rc = RenderPreset(args, job, values, *body);
+    if (rc == 0 && !cacheEntry.empty()) {
+        ProfileScope profile(ProfileStage::RenderCache);
+        StoreCachedRender(cacheEntry, outputs);
+    }
+    return rc;
+}
+
+// Builds morph packs ahead of time so the first render of each set is warm.
+static int RunCompile(const Args& args, Session& session) {
+    if (!session.cacheDirRequested) {
+        std::cerr << "compile needs --cache-dir (and no --no-cache).\n";
+        return 1;
+    }
+
+    std::set<std::string> requested;
+    if (!args.sliderSetName.empty()) {
+        requested.insert(args.sliderSetName);
+    } else if (const PresetIndex* presetIndex = session.GetPresetIndex()) {
+        presetIndex->ForEach([&](const fs::path&, const PresetIndexEntry& entry) {
+            if (!entry.setName.empty()) requested.insert(entry.setName);
+        });
+    }
+    if (requested.empty()) {
+        std::cerr << "No slider sets to compile.\n";
+        return 3;
+    }
+
+    int firstError = 0;
+    size_t compiled = 0;
+    size_t upToDate = 0;
+    for (const auto& name : requested) {
+        LoadedBody* body = nullptr;
+        int rc = session.GetBody(name, args.verbose, body);
+        if (rc != 0) {
+            if (firstError == 0) firstError = rc;
+            continue;
+        }
+        if (body->pack) {
+            upToDate++;
+        } else {
+            compiled++;
+        }
+    }
+
+    std::cout << "Compiled: " << compiled << " morph pack(s), " << upToDate << " up to date, "
+              << session.bodies.byResolvedName.size() << " slider set(s)\n";
+    return firstError;
+}
+
+// Morph targets for the vertex sliders of a loaded body, one per slider, with
+// the diffs of every shape merged onto the concatenated vertex list. uv
+// sliders move no vertices; their names go to outSkipped.
+static std::vector<GlbMorphTarget> BuildSliderTargets(const LoadedBody& body, const std::vector<uint32_t>& vertOffsets,
+                                                      bool yUp, std::vector<std::string>& outSkipped) {
+    const std::vector<MeshShape>& shapes = body.baseShapes;
+    std::vector<const Slider*> sliders;
+    for (const auto& slider : body.sliderSet.sliders) {
+        if (slider.uv) {
+            outSkipped.push_back(slider.name);
+        } else {
+            sliders.push_back(&slider);
+        }
+    }
+
+    std::vector<GlbMorphTarget> targets(sliders.size());
+    WorkerPool().ParallelFor(sliders.size(), [&](size_t t) {
+        const Slider& slider = *sliders[t];
+        std::vector<std::pair<uint32_t, Vec3>> entries;
+        for (size_t s = 0; s < shapes.size(); ++s) {
+            for (const auto& ddf : slider.dataFiles) {
+                if (ddf.targetId != shapes[s].targetId) continue;
+                const TargetDataDiffs* diffs = body.diffData.Find(ddf.dataId, ddf.targetId);
+                if (!diffs) continue;
+                const uint32_t count = diffs->CountBelow(shapes[s].verts.size());
+                for (uint32_t i = 0; i < count; ++i) {
+                    const Vec3 d = {diffs->dx[i], diffs->dy[i], diffs->dz[i]};
+                    entries.emplace_back(vertOffsets[s] + diffs->indices[i], yUp ? ConvertToYUp(d) : d);
+                }
+            }
+        }
+
+        // Several data entries can touch one vertex; their deltas add up, as in
+        // the morph.
+        std::stable_sort(entries.begin(), entries.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+        GlbMorphTarget& target = targets[t];
+        target.name = slider.name;
+        for (const auto& entry : entries) {
+            if (!target.indices.empty() && target.indices.back() == entry.first) {
+                Vec3& d = target.deltas.back();
+                d = {d.x + entry.second.x, d.y + entry.second.y, d.z + entry.second.z};
+            } else {
+                target.indices.push_back(entry.first);
+                target.deltas.push_back(entry.second);
+            }
+        }
+    });
+    return targets;
+}
+
+// A positive clamp slider also snaps its vertices to the diff positions after
+// the weighted delta, which weights alone cannot reproduce.
+static bool PresetNeedsClamp(const Preset& preset, const SliderSet& sliderSet) {
+    for (const auto& slider : sliderSet.sliders) {
+        if (slider.clamp && SliderTargetWeight(preset, slider) > 0.0f) return true;
+    }
+    return false;
+}
+
+// File name stem for a slider set: characters that are not portable in file
+// names become '_'.
+static std::string SliderSetFileStem(const std::string& setName) {
+    std::string stem = setName;
+    for (char& c : stem) {
+        if (static_cast<unsigned char>(c) < 0x20 || std::strchr("<>:\"/\\|?*", c)) c = '_';
+    }
+    return stem.empty() ? "_" : stem;
+}
+
+// Exports each slider set once as a GLB of the base mesh with one sparse morph
+// target per slider, plus a JSON of every preset's target weights, so any
+// preset can be shown by setting weights instead of loading a baked GLB.
+static int RunMorphs(const Args& args, Session& session) {
+    using PresetRefs = std::vector<std::pair<fs::path, PresetIndexEntry>>;
+    std::map<std::string, PresetRefs> presetsBySet;
+    if (const PresetIndex* presetIndex = session.GetPresetIndex()) {
+        presetIndex->ForEach([&](const fs::path& file, const PresetIndexEntry& entry) {
+            if (entry.setName.empty()) return;
+            if (!args.sliderSetName.empty() && entry.setName != args.sliderSetName) return;
+            presetsBySet[entry.setName].emplace_back(file, entry);
+        });
+    }
+    if (!args.sliderSetName.empty()) presetsBySet[args.sliderSetName];
+    if (presetsBySet.empty()) {
+        std::cerr << "No slider sets to export.\n";
+        return 3;
+    }
+
+    // Set names that fall back to the same body share one export.
+    int firstError = 0;
+    std::vector<std::pair<LoadedBody*, PresetRefs>> bodies;
+    for (auto& set : presetsBySet) {
+        LoadedBody* body = nullptr;
+        int rc = session.GetBody(set.first, args.verbose, body);
+        if (rc != 0) {
+            if (firstError == 0) firstError = rc;
+            continue;
+        }
+        auto it = std::find_if(bodies.begin(), bodies.end(), [&](const auto& b) { return b.first == body; });
+        if (it == bodies.end()) it = bodies.insert(bodies.end(), {body, {}});
+        it->second.insert(it->second.end(), set.second.begin(), set.second.end());
+    }
+
+    std::error_code ec;
+    fs::create_directories(args.outDir, ec);
+
+    size_t exported = 0;
+    for (const auto& set : bodies) {
+        LoadedBody* body = set.first;
+
+        std::vector<uint32_t> dataIds;
+        for (const auto& slider : body->sliderSet.sliders) {
+            for (const auto& ddf : slider.dataFiles) dataIds.push_back(ddf.dataId);
+        }
+        LoadDiffSets(*body, dataIds);
+
+        std::vector<Vec3> verts;
+        std::vector<std::array<uint32_t, 3>> tris;
+        std::vector<uint32_t> vertOffsets;
+        ConcatenateShapes(body->baseShapes, verts, tris, &vertOffsets);
+        std::vector<Vec3> normals = ComputeVertexNormals(verts, tris);
+        if (args.exportYUp) {
+            for (auto& v : verts) v = ConvertToYUp(v);
+            for (auto& n : normals) n = Normalize(ConvertToYUp(n));
+        }
+
+        std::vector<std::string> skipped;
+        std::vector<GlbMorphTarget> targets = BuildSliderTargets(*body, vertOffsets, args.exportYUp, skipped);
+
+        const std::string stem = SliderSetFileStem(body->sliderSet.name);
+        const fs::path glbPath = fs::path(args.outDir) / (stem + ".glb");
+        if (!ExportGlb(glbPath.string(), verts, tris, normals, args.exportCompact, targets)) {
+            std::cerr << "Failed to export GLB: " << glbPath.string() << "\n";
+            if (firstError == 0) firstError = 7;
+            continue;
+        }
+
+        std::vector<const Slider*> targetSliders;
+        for (const auto& slider : body->sliderSet.sliders) {
+            if (!slider.uv) targetSliders.push_back(&slider);
+        }
+
+        std::ostringstream json;
+        json << "{\"sliderSet\":" << JsonQuote(body->sliderSet.name) << ",\"glb\":" << JsonQuote(stem + ".glb");
+        json << ",\"targets\":[";
+        for (size_t t = 0; t < targets.size(); ++t) json << (t ? "," : "") << JsonQuote(targets[t].name);
+        json << "],\"skipped\":[";
+        for (size_t t = 0; t < skipped.size(); ++t) json << (t ? "," : "") << JsonQuote(skipped[t]);
+        json << "],\"presets\":{";
+        size_t presetCount = 0;
+        std::vector<std::string> inexact;
+        for (const auto& entry : set.second) {
+            Preset preset;
+            PresetFromIndexEntry(entry.second, preset);
+            json << (presetCount++ ? "," : "") << "\n" << JsonQuote(preset.name) << ":[";
+            for (size_t t = 0; t < targetSliders.size(); ++t) {
+                json << (t ? "," : "") << SliderTargetWeight(preset, *targetSliders[t]);
+            }
+            json << "]";
+            if (PresetNeedsClamp(preset, body->sliderSet)) inexact.push_back(preset.name);
+        }
+        json << "},\n\"inexact\":[";
+        for (size_t i = 0; i < inexact.size(); ++i) json << (i ? "," : "") << JsonQuote(inexact[i]);
+        json << "]}\n";
+
+        const fs::path weightsPath = fs::path(args.outDir) / (stem + ".json");
+        std::ofstream out(weightsPath, std::ios::binary);
+        out << json.str();
+        if (!out) {
+            std::cerr << "Failed to write weights: " << weightsPath.string() << "\n";
+            if (firstError == 0) firstError = 7;
+            continue;
+        }
+
+        exported++;
+        std::cout << "Exported: " << glbPath.string() << " (" << targets.size() << " targets, " << skipped.size()
+                  << " skipped), " << presetCount << " preset weight vector(s)\n";
+    }
+
+    std::cout << "Morph export: " << exported << " of " << bodies.size() << " slider set(s)\n";
+    return firstError;
+}
+
+static void WriteCatalogSliders(std::ostream& json, const std::vector<std::pair<std::string, float>>& sliders) {
+    // Later SetSlider elements for the same slider override earlier ones.
+    std::map<std::string, float> values;
+    for (const auto& slider : sliders) values[slider.first] = slider.second;
+    json << "{";
+    size_t n = 0;
+    for (const auto& value : values) json << (n++ ? "," : "") << JsonQuote(value.first) << ":" << value.second;
+    json << "}";
+}
+
+// Writes every preset (name, set, source file, slider values) as one JSON
+// document so consumers never parse the preset XML themselves.
+static int RunCatalog(const Args& args, Session& session) {
+    const PresetIndex* presetIndex = session.GetPresetIndex();
+    if (!presetIndex || !fs::is_directory(session.paths.presetsDir)) {
+        std::cerr << "Presets folder not found: " << session.paths.presetsDir.string() << "\n";
+        return 3;
+    }
+
+    std::ostringstream json;
+    json << std::setprecision(std::numeric_limits<float>::max_digits10);
+    json << "{\"version\":1,\"root\":" << JsonQuote(session.paths.presetsDir.u8string()) << ",\"presets\":[";
+    size_t presetCount = 0;
+    presetIndex->ForEach([&](const fs::path& file, const PresetIndexEntry& entry) {
+        json << (presetCount++ ? "," : "") << "\n{\"name\":" << JsonQuote(entry.name)
+             << ",\"set\":" << JsonQuote(entry.setName)
+             << ",\"file\":" << JsonQuote(file.lexically_relative(session.paths.presetsDir).generic_u8string())
+             << ",\"big\":";
+        WriteCatalogSliders(json, entry.big);
+        json << ",\"small\":";
+        WriteCatalogSliders(json, entry.small);
+        json << "}";
+    });
+    json << "]}\n";
+
+    if (args.catalogPath.empty()) {
+        std::cout << json.str();
+        return 0;
+    }
+
+    std::ofstream out(fs::u8path(args.catalogPath), std::ios::binary);
+    out << json.str();
+    if (!out) {
+        std::cerr << "Failed to write catalog: " << args.catalogPath << "\n";
+        return 7;
+    }
+    std::cout << "Catalog: " << presetCount << " preset(s) written to " << args.catalogPath << "\n";
+    return 0;
+}
+
+// BodyGen output for LooksMenu: per-ESM templates.ini/morphs.ini written from a
+// rules file in the app's template format,
+//
+//   #morphs=<rule>[;<rule>...]
+//   <template name>=<slider>@<value>[,...]
+//   <preset name>
+//
+// where a line without '=' names a preset whose template is generated from the
+// preset index. Rules are "<plugin>|<formId>" or "All|<gender>|<race>"; NPC
+// editor IDs or names and race names are resolved to FormIDs/editor IDs through
+// the FormIDs CSVs.
+struct FormIdRecord {
+    std::string plugin;
+    std::string formId;
+    std::string editorId;
+    std::string name;
+};
+
+struct FormIdCsvFile {
+    int64_t mtime = -1;
+    uint64_t size = 0;
+    std::vector<FormIdRecord> records;
+};
+
+static std::string TrimAscii(const std::string& text) {
+    const size_t begin = text.find_first_not_of(" \t\r\n\f\v");
+    if (begin == std::string::npos) return {};
+    return text.substr(begin, text.find_last_not_of(" \t\r\n\f\v") - begin + 1);
+}
+
+static std::vector<std::string> SplitText(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for (;;) {
+        const size_t end = text.find(separator, start);
+        parts.push_back(text.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos) return parts;
+        start = end + 1;
+    }
+}
+
+static std::vector<std::string> SplitTrimmed(const std::string& text, char separator) {
+    std::vector<std::string> parts = SplitText(text, separator);
+    for (auto& part : parts) part = TrimAscii(part);
+    return parts;
+}
+
+// Reads one FormIDs CSV. NPC files are "plugin;formId;signature;editorID;name"
+// and keep only NPC_ rows; race files are "plugin;formId;editorID;name".
+static bool ReadFormIdCsv(const fs::path& file, bool npcs, std::vector<FormIdRecord>& outRecords) {
+    std::string text;
+    if (!ReadFileBytes(file, text)) return false;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        const std::vector<std::string> columns = SplitTrimmed(text.substr(start, end - start), ';');
+        start = end + 1;
+
+        const size_t editorColumn = npcs ? 3 : 2;
+        if (columns.size() <= editorColumn || columns[0].empty() || columns[1].empty()) continue;
+        if (npcs && columns[2] != "NPC_") continue;
+        FormIdRecord record;
+        record.plugin = columns[0];
+        record.formId = columns[1];
+        record.editorId = columns[editorColumn];
+        if (columns.size() > editorColumn + 1) record.name = columns[editorColumn + 1];
+        outRecords.push_back(std::move(record));
+    }
+    return true;
+}
+
+// NPC and race lookups over the CSVs in <formIdsDir>/NPCs and <formIdsDir>/Races.
+// Parsed rows are cached per file and reparsed, in parallel, only when a CSV
+// changes; the hash maps are rebuilt from them on open.
+class FormIdIndex {
+public:
+    void Open(const fs::path& formIdsDir, const fs::path& cacheFile) {
+        root_ = formIdsDir;
+        cacheFile_ = cacheFile;
+        if (!cacheFile_.empty()) Load();
+
+        std::map<std::string, FormIdCsvFile> current;
+        std::vector<std::pair<std::string, FormIdCsvFile*>> reparse;
+        for (const char* kind : {"NPCs", "Races"}) {
+            std::error_code ec;
+            for (fs::directory_iterator it(root_ / kind, ec), end; !ec && it != end; it.increment(ec)) {
+                if (!it->is_regular_file() || it->path().extension() != ".csv") continue;
+                const std::string rel = std::string(kind) + "/" + it->path().filename().u8string();
+                const int64_t mtime = FileTimeToInt(it->last_write_time());
+                const uint64_t size = it->file_size();
+                FormIdCsvFile& file = current[rel];
+                auto cached = files_.find(rel);
+                if (cached != files_.end() && cached->second.mtime == mtime && cached->second.size == size) {
+                    file = std::move(cached->second);
+                    continue;
+                }
+                file.mtime = mtime;
+                file.size = size;
+                reparse.emplace_back(rel, &file);
+            }
+        }
+        const bool changed = !reparse.empty() || current.size() != files_.size();
+        files_ = std::move(current);
+
+        WorkerPool().ParallelFor(reparse.size(), [&](size_t i) {
+            const std::string& rel = reparse[i].first;
+            ReadFormIdCsv(root_ / fs::u8path(rel), rel.compare(0, 5, "NPCs/") == 0, reparse[i].second->records);
+        });
+        if (changed && !cacheFile_.empty() && !Save() && gVerbose) {
+            std::cerr << "Failed to write FormID index: " << cacheFile_.string() << "\n";
+        }
+
+        size_t records = 0;
+        for (const auto& file : files_) {
+            const bool npcs = file.first.compare(0, 5, "NPCs/") == 0;
+            for (const auto& record : file.second.records) {
+                records++;
+                const std::string plugin = ToLowerAscii(record.plugin) + "|";
+                if (npcs) {
+                    if (!record.editorId.empty()) npcByEditorId_.emplace(plugin + ToLowerAscii(record.editorId), &record);
+                    if (!record.name.empty()) AddUnique(npcByName_, plugin + ToLowerAscii(record.name), &record);
+                } else if (!record.editorId.empty()) {
+                    raceByEditorId_.emplace(ToLowerAscii(record.editorId), &record);
+                    if (!record.name.empty()) AddUnique(raceByName_, ToLowerAscii(record.name), &record);
+                }
+            }
+        }
+        if (gVerbose) {
+            std::cerr << "FormID index: " << records << " records in " << files_.size() << " files, reparsed "
+                      << reparse.size() << "\n";
+        }
+    }
+
+    size_t FileCount() const { return files_.size(); }
+
+    // An NPC by editor ID, else by unique name, within a plugin.
+    const FormIdRecord* FindNpc(const std::string& plugin, const std::string& key) const {
+        const std::string lookup = ToLowerAscii(plugin) + "|" + ToLowerAscii(key);
+        auto it = npcByEditorId_.find(lookup);
+        if (it != npcByEditorId_.end()) return it->second;
+        auto named = npcByName_.find(lookup);
+        return named == npcByName_.end() ? nullptr : named->second;
+    }
+
+    // A race by editor ID, else by unique name.
+    const FormIdRecord* FindRace(const std::string& key) const {
+        const std::string lookup = ToLowerAscii(key);
+        auto it = raceByEditorId_.find(lookup);
+        if (it != raceByEditorId_.end()) return it->second;
+        auto named = raceByName_.find(lookup);
+        return named == raceByName_.end() ? nullptr : named->second;
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x49465342; // 'BSFI'
+    static constexpr uint32_t kVersion = 1;
+
+    using Lookup = std::unordered_map<std::string, const FormIdRecord*>;
+
+    // Names are not unique; an ambiguous name maps to nothing.
+    static void AddUnique(Lookup& lookup, const std::string& key, const FormIdRecord* record) {
+        auto inserted = lookup.emplace(key, record);
+        if (!inserted.second) inserted.first->second = nullptr;
+    }
+
+    void Load() {
+        std::string data;
+        if (!ReadFileBytes(cacheFile_, data)) return;
+
+        BinaryReader reader(data);
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        std::string root;
+        uint32_t fileCount = 0;
+        reader.Get(magic);
+        reader.Get(version);
+        reader.GetString(root);
+        reader.Get(fileCount);
+        if (!reader.Ok() || magic != kMagic || version != kVersion || root != root_.generic_u8string()) return;
+
+        std::map<std::string, FormIdCsvFile> files;
+        for (uint32_t f = 0; f < fileCount && reader.Ok(); ++f) {
+            std::string rel;
+            FormIdCsvFile file;
+            uint32_t recordCount = 0;
+            reader.GetString(rel);
+            reader.Get(file.mtime);
+            reader.Get(file.size);
+            reader.Get(recordCount);
+            for (uint32_t r = 0; r < recordCount && reader.Ok(); ++r) {
+                FormIdRecord record;
+                reader.GetString(record.plugin);
+                reader.GetString(record.formId);
+                reader.GetString(record.editorId);
+                reader.GetString(record.name);
+                file.records.push_back(std::move(record));
+            }
+            files.emplace(std::move(rel), std::move(file));
+        }
+        if (!reader.Ok() || !reader.AtEnd()) return;
+        files_ = std::move(files);
+    }
+
+    bool Save() const {
+        BinaryWriter writer;
+        writer.Put(kMagic);
+        writer.Put(kVersion);
+        writer.PutString(root_.generic_u8string());
+        writer.Put(static_cast<uint32_t>(files_.size()));
+        for (const auto& file : files_) {
+            writer.PutString(file.first);
+            writer.Put(file.second.mtime);
+            writer.Put(file.second.size);
+            writer.Put(static_cast<uint32_t>(file.second.records.size()));
+            for (const auto& record : file.second.records) {
+                writer.PutString(record.plugin);
+                writer.PutString(record.formId);
+                writer.PutString(record.editorId);
+                writer.PutString(record.name);
+            }
+        }
+        return writer.Save(cacheFile_);
+    }
+
+    fs::path root_;
+    fs::path cacheFile_;
+    std::map<std::string, FormIdCsvFile> files_; // "NPCs/<file>" or "Races/<file>" -> rows
+    Lookup npcByEditorId_;                       // "<plugin>|<editor id>", lower case
+    Lookup npcByName_;                           // "<plugin>|<name>", lower case
+    Lookup raceByEditorId_;
+    Lookup raceByName_;
+};
+
+static bool IsHexFormId(const std::string& text) {
+    return !text.empty() && text.size() <= 8 &&
+           std::all_of(text.begin(), text.end(), [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); });
+}
+
+// Rewrites an NPC rule's editor ID or name to its FormID and an All rule's race
+// name to its editor ID. Other rules and unknown references come back exactly
+// as written, surrounding spaces included.
+static std::string ResolveBodyGenRule(const std::string& rule, const FormIdIndex* formIds, size_t& outUnresolved) {
+    if (!formIds) return rule;
+    const std::vector<std::string> parts = SplitTrimmed(rule, '|');
+    if (parts.size() == 3 && ToLowerAscii(parts[0]) == "all") {
+        if (parts[2].empty()) return rule;
+        const FormIdRecord* race = formIds->FindRace(parts[2]);
+        if (!race) {
+            outUnresolved++;
+            std::cerr << "Warning: unknown race in BodyGen rule: " << rule << "\n";
+            return rule;
+        }
+        return parts[0] + "|" + parts[1] + "|" + race->editorId;
+    }
+    if (parts.size() == 2 && !IsHexFormId(parts[1])) {
+        const FormIdRecord* npc = formIds->FindNpc(parts[0], parts[1]);
+        if (!npc) {
+            outUnresolved++;
+            std::cerr << "Warning: unknown NPC in BodyGen rule: " << rule << "\n";
+            return rule;
+        }
+        return npc->plugin + "|" + npc->formId;
+    }
+    return rule;
+}
+
+// Shortest text that reads back as the same value; for doubles this is how
+// JavaScript prints numbers, so generated templates match the app's.
+template <typename T>
+static std::string ShortestText(T value) {
+    char text[32];
+    for (int precision = 1; precision <= std::numeric_limits<T>::max_digits10; ++precision) {
+        std::snprintf(text, sizeof(text), "%.*g", precision, static_cast<double>(value));
+        if (static_cast<T>(std::strtod(text, nullptr)) == value) break;
+    }
+    return text;
+}
+
+// "<slider>@<value>,..." with value = XML value / 100: big values, then small
+// values for sliders that have no big one; a later value for a slider replaces
+// an earlier one in place.
+static std::string BodyGenTemplate(const PresetIndexEntry& entry) {
+    std::vector<std::pair<std::string, float>> sliders;
+    std::unordered_map<std::string, size_t> position;
+    for (const auto* list : {&entry.big, &entry.small}) {
+        const size_t listStart = sliders.size();
+        for (const auto& slider : *list) {
+            auto it = position.find(slider.first);
+            if (it == position.end()) {
+                position.emplace(slider.first, sliders.size());
+                sliders.push_back(slider);
+            } else if (list == &entry.big || it->second >= listStart) {
+                sliders[it->second].second = slider.second;
+            }
+        }
+    }
+
+    std::string text;
+    for (const auto& slider : sliders) {
+        // The XML value is decimal text; scale that rather than the float.
+        const double value = std::strtod(ShortestText(slider.second).c_str(), nullptr) / 100.0;
+        if (!text.empty()) text += ',';
+        text += slider.first + "@" + ShortestText(value);
+    }
+    return text;
+}
+
+struct BodyGenGroup {
+    std::string morphs; // ';'-separated rules
+    std::vector<std::pair<std::string, std::string>> templates;
+};
+
+// Writes content only when the file differs, through a temporary file renamed
+// over the target so readers never see a partial file. Returns false on error.
+static bool WriteFileIfChanged(const fs::path& file, const std::string& content, bool& outWritten) {
+    outWritten = false;
+    std::string existing;
+    std::error_code ec;
+    if (fs::is_regular_file(file, ec) && ReadFileBytes(file, existing) && existing == content) return true;
+    fs::path tmp = file;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(content.data(), static_cast<std::streamsize>(content.size()));
+        if (!out.good()) {
+            out.close();
+            fs::remove(tmp, ec);
+            return false;
+        }
+    }
+    fs::rename(tmp, file, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    outWritten = true;
+    return true;
+}
+
+static int RunBodyGen(const Args& args, Session& session) {
+    std::string rulesText;
+    if (!ReadFileBytes(fs::u8path(args.rulesPath), rulesText)) {
+        std::cerr << "Failed to read rules: " << args.rulesPath << "\n";
+        return 1;
+    }
+
+    FormIdIndex formIdIndex;
+    const FormIdIndex* formIds = nullptr;
+    if (!args.formIdsDir.empty()) {
+        const fs::path formIdsDir = fs::u8path(args.formIdsDir);
+        formIdIndex.Open(formIdsDir, session.CacheFile("formids", formIdsDir, ".idx"));
+        if (formIdIndex.FileCount() == 0) {
+            std::cerr << "No FormID CSVs found under " << args.formIdsDir << "\n";
+            return 3;
+        }
+        formIds = &formIdIndex;
+    }
+
+    // Same grouping as the app's parseTemplates: groups merge by the text of
+    // their #morphs line and are created by their first template, and a
+    // "name=value" line keeps the text between the first two '='.
+    std::vector<BodyGenGroup> groups;
+    std::unordered_map<std::string, size_t> groupIndex; // #morphs text -> group
+    std::string morphsLine;
+    size_t unresolved = 0;
+    std::vector<std::string> missingPresets;
+    const PresetIndex* presetIndex = nullptr;
+    for (const std::string& rawLine : SplitTrimmed(rulesText, '\n')) {
+        if (rawLine.empty()) continue;
+        if (rawLine[0] == '#') {
+            const std::string prefix = "#morphs=";
+            if (rawLine.compare(0, prefix.size(), prefix) == 0) morphsLine = TrimAscii(rawLine.substr(prefix.size()));
+            continue;
+        }
+
+        std::string name;
+        std::string value;
+        const size_t equals = rawLine.find('=');
+        if (equals != std::string::npos) {
+            const std::vector<std::string> parts = SplitTrimmed(rawLine, '=');
+            name = parts[0];
+            value = parts[1];
+        } else {
+            name = rawLine;
+            if (!presetIndex) presetIndex = session.GetPresetIndex();
+            fs::path file;
+            const PresetIndexEntry* entry = nullptr;
+            if (!presetIndex || !presetIndex->Find(name, file, entry)) {
+                missingPresets.push_back(name);
+                continue;
+            }
+            value = BodyGenTemplate(*entry);
+        }
+        if (name.empty() || value.empty()) continue;
+        auto inserted = groupIndex.emplace(morphsLine, groups.size());
+        if (inserted.second) {
+            std::string morphs;
+            const std::vector<std::string> rules = SplitText(morphsLine, ';');
+            for (size_t r = 0; r < rules.size(); ++r) {
+                morphs += (r ? ";" : "") + ResolveBodyGenRule(rules[r], formIds, unresolved);
+            }
+            groups.push_back({morphs, {}});
+        }
+        groups[inserted.first->second].templates.emplace_back(name, value);
+    }
+    for (const auto& name : missingPresets) std::cerr << "Preset not found: " << name << "\n";
+    if (!missingPresets.empty()) return 2;
+
+    // Same layout as the app's formatINIs, with CRLF line ends.
+    std::string templates;
+    std::string morphs;
+    for (const auto& entry : groups) {
+        if (!templates.empty()) templates += "\r\n\r\n\r\n";
+        templates += "#morphs=" + entry.morphs + "\r\n\r\n\r\n";
+        std::string names;
+        for (size_t t = 0; t < entry.templates.size(); ++t) {
+            if (t) templates += "\r\n\r\n";
+            templates += entry.templates[t].first + "=" + entry.templates[t].second;
+            names += (t ? "|" : "") + entry.templates[t].first;
+        }
+        for (const std::string& rule : SplitText(entry.morphs, ';')) {
+            if (!morphs.empty()) morphs += "\r\n\r\n";
+            morphs += rule + "=" + names;
+        }
+    }
+
+    // Every ESM in the game's Data folder gets the same pair of files.
+    fs::path gameData = fs::u8path(args.gameDataDir);
+    if (gameData.empty()) {
+        fs::path bodySlideRoot = fs::path(args.dataRoot).lexically_normal();
+        if (!bodySlideRoot.has_filename()) bodySlideRoot = bodySlideRoot.parent_path();
+        gameData = bodySlideRoot.parent_path().parent_path();
+    }
+    std::vector<std::string> esms;
+    std::error_code ec;
+    for (fs::directory_iterator it(gameData, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() == ".esm") esms.push_back(it->path().filename().u8string());
+    }
+    std::sort(esms.begin(), esms.end());
+    if (esms.empty()) {
+        std::cerr << "No .esm files found in " << gameData.string() << "\n";
+        return 3;
+    }
+
+    size_t written = 0;
+    size_t unchanged = 0;
+    for (const auto& esm : esms) {
+        const fs::path esmDir = fs::path(args.outDir) / fs::u8path(esm);
+        fs::create_directories(esmDir, ec);
+        for (const auto& file : {std::make_pair("templates.ini", &templates), std::make_pair("morphs.ini", &morphs)}) {
+            bool wrote = false;
+            if (!WriteFileIfChanged(esmDir / file.first, *file.second, wrote)) {
+                std::cerr << "Failed to write " << (esmDir / file.first).string() << "\n";
+                return 7;
+            }
+            (wrote ? written : unchanged)++;
+        }
+    }
+
+    std::cout << "BodyGen: " << groups.size() << " rule group(s) for " << esms.size() << " ESM(s), " << written
+              << " file(s) written, " << unchanged << " unchanged";
+    if (unresolved) std::cout << ", " << unresolved << " unresolved rule(s)";
+    std::cout << "\n";
+    return 0;
+}
+
+bool SameVertices(const std::vector<MeshShape>& a, const std::vector<MeshShape>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t s = 0; s < a.size(); ++s) {
+        if (a[s].verts.size() != b[s].verts.size()) return false;
+        for (size_t i = 0; i < a[s].verts.size(); ++i) {
+            const auto& va = a[s].verts[i];
+            const auto& vb = b[s].verts[i];
+            if (std::memcmp(&va.x, &vb.x, sizeof(float)) != 0 || std::memcmp(&va.y, &vb.y, sizeof(float)) != 0 ||
+                std::memcmp(&va.z, &vb.z, sizeof(float)) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Morph microbenchmark: times the reference per-slider path against the morph
+// engine at every SIMD level the CPU supports, on one preset, and checks that
+// all of them produce bit-identical vertices.
+static int RunBench(const Args& args, Session& session) {
+    const RenderJob& job = args.jobs.front();
+    PresetIndex* presetIndex = job.presetFile.empty() ? session.GetPresetIndex() : nullptr;
+    Preset preset;
+    if (!FindPreset(session.paths.presetsDir, job.presetName, job.presetFile, presetIndex, preset)) {
+        std::cerr << "Preset not found: " << job.presetName << "\n";
+        return 2;
+    }
+
+    std::string sliderSetName = args.sliderSetName.empty() ? preset.setName : args.sliderSetName;
+    LoadedBody* body = nullptr;
+    int rc = session.GetBody(sliderSetName, args.verbose, body);
+    if (rc != 0) return rc;
+    LoadDiffSets(*body, CollectPresetDiffSets(ResolvePresetValues(preset, body->sliderSet), body->sliderSet));
+
+    const SliderSet& sliderSet = body->sliderSet;
+    const DiffDataSets& diffData = body->diffData;
+    size_t vertices = 0;
+    size_t steps = 0;
+    size_t entries = 0;
+    for (const auto& shape : body->baseShapes) vertices += shape.verts.size();
+    const auto plans = BuildMorphPlans(ResolvePresetValues(preset, sliderSet), sliderSet, diffData, body->baseShapes,
+                                       false);
+    for (const auto& plan : plans) {
+        for (const auto& step : plan) {
+            steps++;
+            entries += step.count;
+        }
+    }
+    std::cout << "Bench: " << preset.name << ", " << body->baseShapes.size() << " shapes, " << vertices
+              << " vertices, " << steps << " morph steps, " << entries << " diff entries, " << args.iterations
+              << " iterations, " << WorkerPool().Size() << " thread(s)\n";
+
+    std::vector<MeshShape> expected = body->baseShapes;
+    MorphShapesReference(preset, sliderSet, diffData, expected);
+
+    auto measure = [&](auto&& morph) {
+        std::vector<MeshShape> shapes;
+        double total = 0.0;
+        for (int i = 0; i < args.iterations; ++i) {
+            shapes = body->baseShapes;
+            auto start = std::chrono::steady_clock::now();
+            morph(shapes);
+            total += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        return std::make_pair(total / args.iterations, SameVertices(shapes, expected));
+    };
+
+    std::cout << std::fixed << std::setprecision(4);
+    auto reference = measure([&](std::vector<MeshShape>& shapes) {
+        MorphShapesReference(preset, sliderSet, diffData, shapes);
+    });
+    std::cout << "  reference       " << reference.first << " ms/iter\n";
+
+    // Engine timings include resolving the preset, as the reference path does.
+    auto planning = measure([&](std::vector<MeshShape>& shapes) {
+        BuildMorphPlans(ResolvePresetValues(preset, sliderSet), sliderSet, diffData, shapes, false);
+    });
+    std::cout << "  engine plan     " << planning.first << " ms/iter\n";
+
+    std::vector<SimdLevel> levels = {SimdLevel::Scalar};
+#ifdef BSRENDER_X86_SIMD
+    levels.push_back(SimdLevel::Sse2);
+    if (gSimdLevel == SimdLevel::Avx2) levels.push_back(SimdLevel::Avx2);
+#endif
+
+    bool identical = true;
+    for (SimdLevel level : levels) {
+        auto result = measure([&](std::vector<MeshShape>& shapes) {
+            MorphShapes(ResolvePresetValues(preset, sliderSet), sliderSet, diffData, false, shapes, level);
+        });
+        identical = identical && result.second;
+        std::string label = std::string("engine/") + SimdLevelName(level);
+        label.resize(16, ' ');
+        std::cout << "  " << label << result.first << " ms/iter, "
+                  << std::setprecision(2) << (result.first > 0.0 ? reference.first / result.first : 0.0) << "x"
+                  << std::setprecision(4) << (result.second ? "" : " (MISMATCH)") << "\n";
+    }
+    std::cout << std::defaultfloat;
+
+    if (!identical) {
+        std::cerr << "Morph engine output differs from the reference path.\n";
+        return 6;
+    }
+    return 0;
+}
+
+static const char* DescribeExitCode(int rc) {
+    switch (rc) {
+    case 0: return "ok";
+    case 1: return "invalid request";
+    case 2: return "preset not found";
+    case 3: return "no slider sets found";
+    case 4: return "NIF not found";
+    case 5: return "failed to load base mesh";
+    case 6: return "failed to render";
+    case 7: return "failed to export GLB";
+    default: return "unknown error";
+    }
+}
+
+static bool GetJsonFloat(const JsonFields& fields, const char* key, float& out) {
+    auto it = fields.find(key);
+    if (it == fields.end() || it->second.text.empty()) return true;
+    try {
+        size_t pos = 0;
+        out = std::stof(it->second.text, &pos);
+        if (pos != it->second.text.size()) return false;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// Matches the JSON number grammar, so a bare value can be echoed back as-is.
+static bool IsJsonNumber(const std::string& text) {
+    size_t i = 0;
+    auto digits = [&]() {
+        size_t start = i;
+        while (i < text.size() && std::isdigit(static_cast<unsigned char>(text[i]))) ++i;
+        return i > start;
+    };
+    if (i < text.size() && text[i] == '-') ++i;
+    if (i < text.size() && text[i] == '0') {
+        ++i;
+    } else if (!digits()) {
+        return false;
+    }
+    if (i < text.size() && text[i] == '.') {
+        ++i;
+        if (!digits()) return false;
+    }
+    if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+        ++i;
+        if (i < text.size() && (text[i] == '+' || text[i] == '-')) ++i;
+        if (!digits()) return false;
+    }
+    return i == text.size();
+}
+
+static std::string GetJsonString(const JsonFields& fields, const char* key) {
+    auto it = fields.find(key);
+    return it == fields.end() ? std::string() : it->second.text;
+}
+
+// The --stats-json document: wall/CPU time and bytes read per stage, counts and
+// cache hit rates since the process started. Stage times exclude nested stages.
+static std::string ProfileJson(const Args& args, const Session& session) {
+    const double wallMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gProfile.start).count();
+    const ProfileCacheStats renders = {session.renderCacheHits, session.renderCacheMisses};
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"version\":1,\"command\":"
+        << JsonQuote(!args.command.empty() ? args.command : (args.serve ? "serve" : "render"))
+        << ",\"threads\":" << WorkerPool().Size() << ",\"simd\":" << JsonQuote(SimdLevelName(gSimdLevel))
+        << ",\"wallMs\":" << wallMs << ",\"cpuMs\":" << ProcessCpuMs() << ",\"peakRssBytes\":" << PeakRssBytes()
+        << ",\"bytesRead\":" << gProfile.bytesRead.load() << ",\"stages\":{";
+    for (size_t i = 0; i < static_cast<size_t>(ProfileStage::Count); ++i) {
+        const ProfileStageStats& stage = gProfile.stages[i];
+        out << (i ? "," : "") << JsonQuote(kProfileStageNames[i]) << ":{\"calls\":" << stage.calls
+            << ",\"wallMs\":" << stage.wallMs << ",\"cpuMs\":" << stage.cpuMs
+            << ",\"bytesRead\":" << stage.bytesRead.load() << "}";
+    }
+    out << "},\"counts\":{\"jobs\":" << gProfile.jobs << ",\"views\":" << gProfile.views
+        << ",\"vertices\":" << gProfile.vertices << ",\"triangles\":" << gProfile.triangles
+        << ",\"activeSliders\":" << gProfile.activeSliders << ",\"diffEntries\":" << gProfile.diffEntries
+        << ",\"fragments\":" << gProfile.fragments << "},\"caches\":{";
+    const std::pair<const char*, ProfileCacheStats> caches[] = {
+        {"bodies", gProfile.bodies},
+        {"morphPacks", gProfile.morphPacks},
+        {"contentHashes", gProfile.contentHashes},
+        {"renders", renders},
+    };
+    bool first = true;
+    for (const auto& cache : caches) {
+        const uint64_t lookups = cache.second.hits + cache.second.misses;
+        out << (first ? "" : ",") << JsonQuote(cache.first) << ":{\"hits\":" << cache.second.hits
+            << ",\"misses\":" << cache.second.misses << ",\"hitRate\":";
+        if (lookups) {
+            out << static_cast<double>(cache.second.hits) / static_cast<double>(lookups);
+        } else {
+            out << "null";
+        }
+        out << "}";
+        first = false;
+    }
+    out << "}}";
+    return out.str();
+}
+
+// Prints the --profile summary and writes --stats-json.
+static void ReportProfile(const Args& args, const Session& session, std::ostream& out) {
+    if (!gProfile.enabled) return;
+    const double wallMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gProfile.start).count();
+    out << std::fixed << std::setprecision(1) << "Profile: " << wallMs << " ms wall, " << ProcessCpuMs()
+        << " ms CPU, peak RSS " << (PeakRssBytes() / (1024.0 * 1024.0)) << " MiB, "
+        << (gProfile.bytesRead.load() / 1024.0) << " KiB read\n";
+    for (size_t i = 0; i < static_cast<size_t>(ProfileStage::Count); ++i) {
+        const ProfileStageStats& stage = gProfile.stages[i];
+        if (stage.calls == 0) continue;
+        out << "  " << std::left << std::setw(18) << kProfileStageNames[i] << std::right << std::setw(6)
+            << stage.calls << "x " << std::setw(10) << stage.wallMs << " ms wall " << std::setw(10) << stage.cpuMs
+            << " ms CPU " << std::setw(10) << (stage.bytesRead.load() / 1024.0) << " KiB read\n";
+    }
+    out << "  Counts: " << gProfile.jobs << " job(s), " << gProfile.views << " view(s), " << gProfile.vertices
+        << " vertices, " << gProfile.triangles << " triangles, " << gProfile.activeSliders << " active sliders, "
+        << gProfile.diffEntries << " diff entries, " << gProfile.fragments << " fragments\n";
+    out << "  Caches (hits/misses): bodies " << gProfile.bodies.hits << "/" << gProfile.bodies.misses
+        << ", morph packs " << gProfile.morphPacks.hits << "/" << gProfile.morphPacks.misses << ", content hashes "
+        << gProfile.contentHashes.hits << "/" << gProfile.contentHashes.misses << ", renders "
+        << session.renderCacheHits << "/" << session.renderCacheMisses << "\n"
+        << std::defaultfloat;
+
+    if (!args.statsJsonPath.empty()) {
+        std::ofstream json(args.statsJsonPath, std::ios::binary);
+        json << ProfileJson(args, session) << "\n";
+        if (!json) std::cerr << "Warning: failed to write stats: " << args.statsJsonPath << "\n";
+    }
+}
+
+// Serves newline-delimited JSON requests from stdin until EOF or a shutdown
+// request. Slider sets stay loaded between requests, so a warm render costs one
+// morph plus one raster.
+static int RunServer(const Args& args, Session& session) {
+    std::ostream reply(std::cout.rdbuf());
+    std::streambuf* stdoutBuf = std::cout.rdbuf(std::cerr.rdbuf());
+
+    BodyCache& bodies = session.bodies;
+    reply << "{\"ready\":true}\n" << std::flush;
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.find_first_not_of(" \t") == std::string::npos) continue;
+
+        auto started = std::chrono::steady_clock::now();
+        JsonFields request;
+        std::ostringstream response;
+        if (!ParseJsonObject(line, request)) {
+            response << "{\"ok\":false,\"code\":1,\"error\":\"malformed request\"}";
+            reply << response.str() << "\n" << std::flush;
+            continue;
+        }
+
+        response << "{";
+        auto id = request.find("id");
+        if (id != request.end() && !id->second.text.empty()) {
+            const bool numericId = !id->second.isString && IsJsonNumber(id->second.text);
+            response << "\"id\":" << (numericId ? id->second.text : JsonQuote(id->second.text)) << ",";
+        }
+
+        std::string op = GetJsonString(request, "op");
+        if (op.empty()) op = "render";
+
+        if (op == "ping") {
+            response << "\"ok\":true,\"sets\":" << bodies.byResolvedName.size() << "}";
+        } else if (op == "invalidate") {
+            bodies.Clear();
+            response << "\"ok\":true}";
+        } else if (op == "stats") {
+            if (gProfile.enabled) {
+                response << "\"ok\":true,\"stats\":" << ProfileJson(args, session) << "}";
+            } else {
+                response << "\"ok\":false,\"code\":1,\"error\":\"profiling is off; start with --profile\"}";
+            }
+        } else if (op == "shutdown") {
+            response << "\"ok\":true}";
+            reply << response.str() << "\n" << std::flush;
+            break;
+        } else if (op == "render") {
+            Args reqArgs = args;
+            RenderJob job;
+            job.presetName = GetJsonString(request, "preset");
+            job.presetFile = GetJsonString(request, "presetFile");
+            job.outPath = GetJsonString(request, "out");
+            job.exportGlbPath = GetJsonString(request, "glb");
+            if (request.count("sliderSet")) reqArgs.sliderSetName = GetJsonString(request, "sliderSet");
+            if (request.count("yup")) reqArgs.exportYUp = GetJsonString(request, "yup") != "false";
+            if (request.count("compact")) reqArgs.exportCompact = GetJsonString(request, "compact") != "false";
+            if (request.count("views")) reqArgs.viewSpec = GetJsonString(request, "views");
+            if (request.count("sheet")) reqArgs.sheet = GetJsonString(request, "sheet") != "false";
+            if (request.count("format")) reqArgs.imageFormat = GetJsonString(request, "format");
+
+            float size = static_cast<float>(reqArgs.size);
+            float mips = static_cast<float>(reqArgs.mipLevels);
+            bool valid = !job.presetName.empty() && !job.outPath.empty() &&
+                         GetJsonFloat(request, "size", size) &&
+                         GetJsonFloat(request, "yaw", reqArgs.yawDeg) &&
+                         GetJsonFloat(request, "pitch", reqArgs.pitchDeg) &&
+                         GetJsonFloat(request, "roll", reqArgs.rollDeg) &&
+                         GetJsonFloat(request, "mips", mips);
+            ImageFormat format;
+            if (!reqArgs.imageFormat.empty() && !ParseImageFormat(reqArgs.imageFormat, format)) valid = false;
+            if (!std::isfinite(size)) valid = false;
+            reqArgs.size = static_cast<int>(std::clamp(std::isfinite(size) ? size : 0.0f, 64.0f, 16384.0f));
+            if (!std::isfinite(mips)) valid = false;
+            reqArgs.mipLevels = static_cast<int>(std::clamp(std::isfinite(mips) ? mips : 0.0f, 0.0f, 12.0f));
+
+            int rc = 1;
+            const size_t hitsBefore = session.renderCacheHits;
+            if (valid) {
+                bodies.Refresh(args.verbose);
+                session.MarkStale();
+                rc = RunJob(reqArgs, session, job);
+            }
+
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+            if (rc == 0) {
+                response << "\"ok\":true,\"out\":" << JsonQuote(job.outPath);
+                if (!job.exportGlbPath.empty()) response << ",\"glb\":" << JsonQuote(job.exportGlbPath);
+                if (session.renderCache) response << ",\"cached\":" << (session.renderCacheHits > hitsBefore ? "true" : "false");
+            } else {
+                response << "\"ok\":false,\"code\":" << rc << ",\"error\":" << JsonQuote(DescribeExitCode(rc));
+            }
+            response << ",\"ms\":" << std::fixed << std::setprecision(1) << ms << "}";
+        } else {
+            response << "\"ok\":false,\"code\":1,\"error\":" << JsonQuote("unknown op: " + op) << "}";
+        }
+
+        reply << response.str() << "\n" << std::flush;
+    }
+
+    std::cout.rdbuf(stdoutBuf);
+    return 0;
+}
+
+// Renders every job of the command line or batch file, continuing past
+// failures. Returns the first failure's exit code.
+static int RunBatch(const Args& args, Session& session) {
+    BodyCache& bodies = session.bodies;
+    int firstError = 0;
+    size_t failed = 0;
+    for (const auto& job : args.jobs) {
+        int rc = RunJob(args, session, job);
+        if (rc != 0) {
+            failed++;
+            if (firstError == 0) firstError = rc;
+        }
+    }
+
+    if (args.jobs.size() > 1) {
+        std::cout << "Batch: " << (args.jobs.size() - failed) << " rendered, " << failed << " failed, "
+                  << bodies.byResolvedName.size() << " slider set(s) loaded\n";
+        if (session.renderCache) {
+            std::cout << "Render cache: " << session.renderCacheHits << " hit(s), " << session.renderCacheMisses
+                      << " miss(es)\n";
+        }
+    }
+
+    return firstError;
+}
+
+int BsrenderMain(int argc, char** argv) {
+    Args args;
+    if (!ParseArgs(argc, argv, args)) {
+        PrintUsage();
+        return 1;
+    }
+    gVerbose = args.verbose;
+    gThreadCount = args.threads;
+    gProfile.enabled = args.profile;
+    gProfile.start = std::chrono::steady_clock::now();
+
+    if (!args.batchFile.empty() && !LoadBatchFile(args.batchFile, args.jobs)) {
+        std::cerr << "Failed to read batch file: " << args.batchFile << "\n";
+        return 1;
+    }
+
+    fs::path bodySlideRoot = args.dataRoot;
+    Session session;
+    session.paths.presetsDir = bodySlideRoot / "SliderPresets";
+    session.paths.sliderSetsDir = bodySlideRoot / "SliderSets";
+    session.paths.shapeDataRoot = bodySlideRoot / "ShapeData";
+
+    if (!args.noCache) {
+        if (!args.cacheDir.empty()) {
+            session.cacheDir = args.cacheDir;
+            session.cacheDirRequested = true;
+        } else {
+            std::error_code ec;
+            fs::path tempDir = fs::temp_directory_path(ec);
+            if (!ec) session.cacheDir = tempDir / "bsrender-cache";
+        }
+    }
+    // A single lookup is no slower as a plain scan, so indexes are kept only when
+    // asked for or when they are reused within the process.
+    session.useIndexes = session.cacheDirRequested || args.serve || args.jobs.size() > 1 || args.command == "morphs" ||
+                         args.command == "catalog" || args.command == "bodygen";
+    // Stored renders are never evicted, so they only go where the caller chose.
+    session.renderCache = args.renderCache && session.cacheDirRequested;
+    if (args.renderCache && !session.cacheDirRequested) {
+        std::cerr << "Warning: --render-cache needs --cache-dir; rendering without it.\n";
+    }
+
+    int rc = 0;
+    if (args.command == "compile") {
+        rc = RunCompile(args, session);
+    } else if (args.command == "bench") {
+        rc = RunBench(args, session);
+    } else if (args.command == "morphs") {
+        rc = RunMorphs(args, session);
+    } else if (args.command == "catalog") {
+        rc = RunCatalog(args, session);
+    } else if (args.command == "bodygen") {
+        rc = RunBodyGen(args, session);
+    } else if (args.serve) {
+        rc = RunServer(args, session);
+    } else {
+        rc = RunBatch(args, session);
+    }
+
+    // Server responses own stdout; its summary goes with the logging.
+    ReportProfile(args, session, args.serve ? std::cerr : std::cout);
+    return rc;
+}
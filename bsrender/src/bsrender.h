@@ -0,0 +1,487 @@
+// bsrender pipeline: BodySlide data loading, the morph engine, rasterization
+// and the image and mesh encoders, shared by bsrender and bsrender_bench.
+// Everything else, including the indexes and caches behind a Session, stays
+// private to bsrender.cpp.
+#pragma once
+
+#include <BasicTypes.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+extern unsigned gThreadCount; // 0: one per hardware thread
+
+// Runs the bsrender command line; returns its exit code.
+int BsrenderMain(int argc, char** argv);
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads) {
+        for (unsigned i = 1; i < threads; ++i) {
+            workers_.emplace_back([this] { WorkerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    unsigned Size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    template <typename Fn>
+    void ParallelFor(size_t count, Fn&& fn) {
+        if (workers_.empty() || count <= 1) {
+            for (size_t i = 0; i < count; ++i) fn(i);
+            return;
+        }
+
+        Batch batch;
+        batch.count = count;
+        batch.fn = [&fn](size_t i) { fn(i); };
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batch_ = &batch;
+            generation_++;
+        }
+        wake_.notify_all();
+        Drain(batch);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return batch.active == 0; });
+        batch_ = nullptr;
+    }
+
+private:
+    struct Batch {
+        size_t count = 0;
+        std::function<void(size_t)> fn;
+        std::atomic<size_t> next{0};
+        unsigned active = 0; // workers inside Drain; guarded by mutex_
+    };
+
+    static void Drain(Batch& batch) {
+        for (size_t i = batch.next++; i < batch.count; i = batch.next++) batch.fn(i);
+    }
+
+    void WorkerLoop() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [&] { return stop_ || (batch_ && generation_ != seen); });
+            if (stop_) return;
+            seen = generation_;
+            Batch* batch = batch_;
+            batch->active++;
+            lock.unlock();
+            Drain(*batch);
+            lock.lock();
+            if (--batch->active == 0) done_.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    Batch* batch_ = nullptr;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+};
+
+// Process-wide pool sized by gThreadCount on first use.
+ThreadPool& WorkerPool();
+
+std::string JsonQuote(const std::string& in);
+
+struct ViewAngles {
+    float yawDeg = 45.0f;
+    float pitchDeg = 0.0f;
+    float rollDeg = 0.0f;
+};
+
+struct Preset {
+    std::string name;
+    std::string setName;
+    std::unordered_map<std::string, float> big;
+    std::unordered_map<std::string, float> small;
+};
+
+bool LoadPresetFromFile(const fs::path& file, const std::string& presetName, Preset& outPreset);
+
+// Dense integer IDs for names. A name gets the next ID the first time it is
+// interned and keeps it, so IDs can index flat arrays.
+class SymbolTable {
+public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    uint32_t Intern(const std::string& name) {
+        auto it = ids_.emplace(name, static_cast<uint32_t>(names_.size()));
+        if (it.second) names_.push_back(name);
+        return it.first->second;
+    }
+
+    uint32_t Find(const std::string& name) const {
+        auto it = ids_.find(name);
+        return it == ids_.end() ? kNone : it->second;
+    }
+
+    const std::string& Name(uint32_t id) const { return names_[id]; }
+    size_t Size() const { return names_.size(); }
+
+private:
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<std::string> names_;
+};
+
+struct SliderDataFile {
+    std::string dataName;
+    std::string targetName;
+    std::string fileName;
+    bool local = true;
+    // Interned into the body's DiffDataSets tables; see InternMorphSymbols.
+    uint32_t dataId = SymbolTable::kNone;
+    uint32_t targetId = SymbolTable::kNone;
+};
+
+struct Slider {
+    std::string name;
+    bool invert = false;
+    bool clamp = false;
+    bool zap = false;
+    bool uv = false;
+    float defaultValue = 0.0f;
+    std::vector<SliderDataFile> dataFiles;
+};
+
+struct SliderSet {
+    std::string name;
+    std::string dataFolder;
+    std::string sourceFile;
+    fs::path ospFile;
+    std::vector<std::pair<std::string, std::string>> shapes; // shapeName, targetName
+    std::vector<Slider> sliders;
+};
+
+bool LoadSliderSetFromFile(const fs::path& file, const std::string& setName, SliderSet& outSet);
+
+// One allocation holding every diff set of an OSD file. Each set is laid out as
+// an index array followed by dx, dy and dz float arrays, every array starting on
+// a kAlign boundary.
+class DiffArena {
+public:
+    static constexpr size_t kAlign = 32;
+
+    static size_t AlignUp(size_t bytes) {
+        return (bytes + kAlign - 1) & ~(kAlign - 1);
+    }
+
+    static size_t SetBytes(size_t count) {
+        return AlignUp(count * sizeof(uint16_t)) + 3 * AlignUp(count * sizeof(float));
+    }
+
+    explicit DiffArena(size_t bytes) : storage_(new uint8_t[bytes + kAlign]), capacity_(bytes) {
+        uintptr_t raw = reinterpret_cast<uintptr_t>(storage_.get());
+        base_ = storage_.get() + (AlignUp(raw) - raw);
+    }
+
+    template <typename T>
+    T* Take(size_t count) {
+        T* p = reinterpret_cast<T*>(base_ + used_);
+        used_ += AlignUp(count * sizeof(T));
+        return p;
+    }
+
+    size_t Capacity() const { return capacity_; }
+
+private:
+    std::unique_ptr<uint8_t[]> storage_;
+    uint8_t* base_ = nullptr;
+    size_t capacity_ = 0;
+    size_t used_ = 0;
+};
+
+// Diffs of one OSD data block as sorted structure-of-arrays: vertex indices are
+// strictly increasing, duplicates in the file collapse to the last entry. The
+// arrays live in memory owned by `owner`.
+struct TargetDataDiffs {
+    uint32_t count = 0;
+    const uint16_t* indices = nullptr;
+    const float* dx = nullptr;
+    const float* dy = nullptr;
+    const float* dz = nullptr;
+    std::shared_ptr<const void> owner;
+
+    size_t size() const { return count; }
+
+    // Number of leading entries whose index is below vertexCount.
+    uint32_t CountBelow(size_t vertexCount) const {
+        if (vertexCount > std::numeric_limits<uint16_t>::max()) return count;
+        return static_cast<uint32_t>(std::lower_bound(indices, indices + count, static_cast<uint16_t>(vertexCount)) - indices);
+    }
+};
+
+// OSD data name -> target shape name
+using OsdDataNames = std::unordered_map<std::string, std::string>;
+
+struct OSDFile {
+    std::unordered_map<std::string, TargetDataDiffs> dataDiffs;
+    size_t storageBytes = 0;
+
+    // Decodes the data blocks of an OSD file. With `only`, blocks that are not
+    // listed are skipped with a seek instead of being read and decoded.
+    bool Read(const fs::path& fileName, const OsdDataNames* only = nullptr);
+};
+
+// Diff sets of one body. Set and target names are interned; sets are stored by
+// set ID along with the ID of the target they were loaded for, so the morph
+// resolves a slider's data without hashing or comparing strings.
+struct DiffDataSets {
+    SymbolTable setNames;
+    SymbolTable targetNames;
+    std::vector<TargetDataDiffs> sets;  // by set ID
+    std::vector<uint32_t> setTargets;   // by set ID; kNone while not resident
+    size_t resident = 0;
+
+    size_t Size() const { return resident; }
+
+    bool HasSet(uint32_t set) const {
+        return set < setTargets.size() && setTargets[set] != SymbolTable::kNone;
+    }
+
+    bool HasSet(const std::string& set) const { return HasSet(setNames.Find(set)); }
+
+    size_t GetSetSize(const std::string& set) const {
+        const uint32_t id = setNames.Find(set);
+        return HasSet(id) ? sets[id].size() : 0;
+    }
+
+    const TargetDataDiffs* Find(uint32_t set, uint32_t target) const {
+        if (target == SymbolTable::kNone || set >= setTargets.size() || setTargets[set] != target) return nullptr;
+        return &sets[set];
+    }
+
+    const TargetDataDiffs* Find(const std::string& set, const std::string& target) const {
+        return Find(setNames.Find(set), targetNames.Find(target));
+    }
+
+    void MoveToSet(const std::string& name, const std::string& target, TargetDataDiffs&& inDiffData) {
+        const uint32_t id = setNames.Intern(name);
+        if (id >= sets.size()) {
+            sets.resize(id + 1);
+            setTargets.resize(id + 1, SymbolTable::kNone);
+        }
+        if (setTargets[id] == SymbolTable::kNone) resident++;
+        sets[id] = std::move(inDiffData);
+        setTargets[id] = targetNames.Intern(target);
+    }
+
+    void Remove(const std::string& name) {
+        const uint32_t id = setNames.Find(name);
+        if (!HasSet(id)) return;
+        sets[id] = TargetDataDiffs();
+        setTargets[id] = SymbolTable::kNone;
+        resident--;
+    }
+
+    // Calls fn(name, target, diffs) for every resident set, in set ID order.
+    template <typename Fn>
+    void ForEachSet(Fn&& fn) const {
+        for (uint32_t id = 0; id < setTargets.size(); ++id) {
+            if (setTargets[id] != SymbolTable::kNone) fn(setNames.Name(id), targetNames.Name(setTargets[id]), sets[id]);
+        }
+    }
+
+    // Reads the listed data blocks of each OSD file (path -> data names) and
+    // moves them into the sets; other blocks in those files are skipped.
+    bool LoadData(const std::unordered_map<std::string, OsdDataNames>& osdNames);
+
+    bool ApplyDiff(const std::string& set, const std::string& target, float percent, std::vector<nifly::Vector3>& inOut) const {
+        if (percent == 0.0f) return false;
+        const TargetDataDiffs* found = Find(set, target);
+        if (!found) return false;
+
+        const TargetDataDiffs& diffs = *found;
+        const uint32_t count = diffs.CountBelow(inOut.size());
+        for (uint32_t i = 0; i < count; ++i) {
+            nifly::Vector3& v = inOut[diffs.indices[i]];
+            v.x += diffs.dx[i] * percent;
+            v.y += diffs.dy[i] * percent;
+            v.z += diffs.dz[i] * percent;
+        }
+        return true;
+    }
+
+    bool ApplyClamp(const std::string& set, const std::string& target, std::vector<nifly::Vector3>& inOut) const {
+        const TargetDataDiffs* found = Find(set, target);
+        if (!found) return false;
+
+        const TargetDataDiffs& diffs = *found;
+        const uint32_t count = diffs.CountBelow(inOut.size());
+        for (uint32_t i = 0; i < count; ++i) {
+            nifly::Vector3& v = inOut[diffs.indices[i]];
+            v.x = diffs.dx[i];
+            v.y = diffs.dy[i];
+            v.z = diffs.dz[i];
+        }
+        return true;
+    }
+
+    void GetDiffIndices(const std::string& set, const std::string& target, std::vector<uint16_t>& outIndices, float threshold = 0.0f) const {
+        const TargetDataDiffs* found = Find(set, target);
+        if (!found) return;
+
+        const TargetDataDiffs& diffs = *found;
+        for (uint32_t i = 0; i < diffs.count; ++i) {
+            if (std::fabs(diffs.dx[i]) > threshold || std::fabs(diffs.dy[i]) > threshold || std::fabs(diffs.dz[i]) > threshold) {
+                outIndices.push_back(diffs.indices[i]);
+            }
+        }
+
+        std::sort(outIndices.begin(), outIndices.end());
+        outIndices.erase(std::unique(outIndices.begin(), outIndices.end()), outIndices.end());
+    }
+
+    // Bytes held by the diff arrays, and an estimate of what the same entries cost
+    // as one std::unordered_map<uint16_t, nifly::Vector3> per set (node with next
+    // pointer and value, allocator overhead, one bucket pointer per entry).
+    void MemoryUsage(size_t& outEntries, size_t& outBytes, size_t& outHashMapBytes) const {
+        outEntries = 0;
+        outBytes = 0;
+        std::unordered_map<const void*, size_t> owners;
+        ForEachSet([&](const std::string&, const std::string&, const TargetDataDiffs& diffs) {
+            outEntries += diffs.count;
+            owners[diffs.owner.get()] += DiffArena::SetBytes(diffs.count);
+        });
+        for (const auto& owner : owners) outBytes += owner.second;
+
+        constexpr size_t kNodeBytes = sizeof(void*) + sizeof(std::pair<const uint16_t, nifly::Vector3>);
+        constexpr size_t kMallocOverhead = 16;
+        const size_t nodeBytes = ((kNodeBytes + kMallocOverhead + 15) / 16) * 16;
+        outHashMapBytes = outEntries * (nodeBytes + sizeof(void*)) +
+                          resident * (sizeof(std::unordered_map<uint16_t, nifly::Vector3>) + kMallocOverhead);
+    }
+};
+
+struct MeshShape {
+    std::string name;
+    std::string targetName;
+    uint32_t targetId = SymbolTable::kNone; // see InternMorphSymbols
+    std::vector<nifly::Vector3> verts;
+    std::vector<nifly::Triangle> tris;
+};
+
+// OSD path -> (data name -> target name)
+using OsdRefs = std::unordered_map<std::string, OsdDataNames>;
+
+class ShapeDataIndex;
+
+OsdRefs ResolveOsdRefs(const SliderSet& sliderSet,
+                       const fs::path& shapeDataRoot,
+                       bool verbose,
+                       const ShapeDataIndex* shapeIndex = nullptr,
+                       std::vector<fs::path>* outProbed = nullptr);
+void InternMorphSymbols(SliderSet& sliderSet, std::vector<MeshShape>& shapes, DiffDataSets& diffData);
+
+// A preset's value for every slider of a set, indexed like sliderSet.sliders.
+// Resolved once per job; the passes after it index by slider, not by name.
+using SliderValues = std::vector<float>;
+
+SliderValues ResolvePresetValues(const Preset& preset, const SliderSet& sliderSet);
+
+enum class SimdLevel { Scalar, Sse2, Avx2 };
+
+// Best level the CPU supports, detected at startup.
+extern const SimdLevel gSimdLevel;
+
+const char* SimdLevelName(SimdLevel level);
+
+struct MorphStep {
+    const TargetDataDiffs* diffs = nullptr;
+    uint32_t count = 0; // entries addressing vertices of the shape
+    float weight = 0.0f;
+    bool clamp = false; // overwrite with the diff instead of adding
+};
+
+std::vector<std::vector<MorphStep>> BuildMorphPlans(const SliderValues& values, const SliderSet& sliderSet,
+                                                    const DiffDataSets& diffData,
+                                                    const std::vector<MeshShape>& shapes, bool verbose);
+void MorphShapesReference(const Preset& preset, const SliderSet& sliderSet, const DiffDataSets& diffData,
+                          std::vector<MeshShape>& shapes);
+void MorphShapes(const SliderValues& values, const SliderSet& sliderSet, const DiffDataSets& diffData,
+                 bool verbose, std::vector<MeshShape>& shapes, SimdLevel level = gSimdLevel);
+// True when both hold the same shapes with bit-identical vertices.
+bool SameVertices(const std::vector<MeshShape>& a, const std::vector<MeshShape>& b);
+
+struct Vec3 {
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+};
+
+void ConcatenateShapes(const std::vector<MeshShape>& shapes, std::vector<Vec3>& outVerts,
+                       std::vector<std::array<uint32_t, 3>>& outTris,
+                       std::vector<uint32_t>* outVertOffsets = nullptr);
+
+// Vertex -> triangle adjacency in CSR form: the triangles with a corner on
+// vertex v are triangles[offsets[v] .. offsets[v + 1]), in triangle order, once
+// per such corner. Topology does not change with the morph, so a body builds
+// it once for its base mesh.
+struct VertexAdjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+
+    bool Fits(size_t vertCount, size_t triCount) const {
+        return offsets.size() == vertCount + 1 && triangles.size() == triCount * 3;
+    }
+};
+
+VertexAdjacency BuildVertexAdjacency(size_t vertCount, const std::vector<std::array<uint32_t, 3>>& tris);
+std::vector<Vec3> ComputeVertexNormals(const std::vector<Vec3>& verts,
+                                       const std::vector<std::array<uint32_t, 3>>& tris,
+                                       const VertexAdjacency* adjacency = nullptr);
+
+bool RenderViews(const std::vector<Vec3>& verts,
+                 const std::vector<Vec3>& modelNormals,
+                 const std::vector<std::array<uint32_t, 3>>& tris,
+                 int size,
+                 const std::vector<ViewAngles>& views,
+                 std::vector<std::vector<uint8_t>>& outImages);
+
+std::vector<uint8_t> EncodePng(const uint8_t* rgba, int w, int h, int level);
+std::vector<uint8_t> EncodeQoi(const uint8_t* rgba, int w, int h);
+
+// One glTF morph target: position deltas at strictly increasing vertex
+// indices, written as a sparse accessor over an implicit all-zero buffer.
+struct GlbMorphTarget {
+    std::string name;
+    std::vector<uint32_t> indices;
+    std::vector<Vec3> deltas;
+};
+
+bool ExportGlb(const std::string& path,
+               const std::vector<Vec3>& verts,
+               const std::vector<std::array<uint32_t, 3>>& tris,
+               const std::vector<Vec3>& normals,
+               bool compact,
+               const std::vector<GlbMorphTarget>& targets = {});
@@ -0,0 +1,34 @@
+# Runs 'bsrender bodygen' on tests/bodygen and compares the INI files it writes
+# byte for byte with the output of the app's formatINIs for the same rules.
+#   cmake -DBSRENDER=<exe> -DFIXTURE=<tests/bodygen> -DWORK_DIR=<dir> -P bodygen_compare.cmake
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+
+foreach(run first second)
+    execute_process(
+        COMMAND "${BSRENDER}" bodygen --no-cache
+            --data-root "${FIXTURE}/Data/Tools/BodySlide"
+            --game-data "${FIXTURE}/Data"
+            --rules "${FIXTURE}/rules.txt"
+            --out-dir "${WORK_DIR}"
+        RESULT_VARIABLE rc
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE output)
+    if(NOT rc EQUAL 0)
+        message(FATAL_ERROR "bodygen (${run} run) exited with ${rc}:\n${output}")
+    endif()
+endforeach()
+
+# The second run found identical files and must have left them alone.
+if(NOT output MATCHES " 0 file\\(s\\) written, 2 unchanged")
+    message(FATAL_ERROR "bodygen rewrote unchanged files:\n${output}")
+endif()
+
+foreach(ini templates.ini morphs.ini)
+    execute_process(
+        COMMAND "${CMAKE_COMMAND}" -E compare_files "${WORK_DIR}/Test.esm/${ini}" "${FIXTURE}/expected/${ini}"
+        RESULT_VARIABLE differs)
+    if(differs)
+        message(FATAL_ERROR "${ini} differs from expected/${ini}")
+    endif()
+endforeach()